@@ -16,6 +16,15 @@ if (platform === 'darwin') {
     `${sdkPath}/System/Library/Frameworks/CoreFoundation.framework/CoreFoundation.tbd`;
 } else if (platform === 'linux') {
   linkConfig.link_libs = ['m', 'pthread', 'dl', 'rt'];
+  // The device table holds 64 pads unless MOON_GAMEPAD_MAX_DEVICES says otherwise.
+  const maxDevices = process.env.MOON_GAMEPAD_MAX_DEVICES;
+  if (maxDevices !== undefined && maxDevices !== '') {
+    const n = Number.parseInt(maxDevices, 10);
+    if (!(n > 0)) {
+      throw new Error(`Invalid MOON_GAMEPAD_MAX_DEVICES: ${maxDevices}`);
+    }
+    stubCcFlags = `-DMOON_GAMEPAD_LINUX_MAX_DEVICES=${n}`;
+  }
 } else if (platform === 'win32') {
   linkConfig.link_libs = [
     'user32',
@@ -1,3 +1,6 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -101,27 +104,62 @@ static char *moonbit_string_to_ascii_cstr(moonbit_string_t s) {
 #if defined(__APPLE__)
 #include <CoreFoundation/CoreFoundation.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <IOKit/hid/IOHIDLib.h>
 #include <IOKit/hid/IOHIDKeys.h>
 #include <IOKit/hid/IOHIDManager.h>
 #include <IOKit/IOKitLib.h>
 #include <pthread.h>
 #include <time.h>
+#include <unistd.h>
 #endif
 
 #if defined(__linux__)
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
+#include <ftw.h>
+#include <linux/futex.h>
 #include <linux/input.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define MOON_GAMEPAD_HAVE_IO_URING 1
+#endif
+#endif
+// Every per-device table in the backend is sized by this; hosts with more
+// pads build with -DMOON_GAMEPAD_LINUX_MAX_DEVICES=N (see build.js).
+#ifndef MOON_GAMEPAD_LINUX_MAX_DEVICES
+#define MOON_GAMEPAD_LINUX_MAX_DEVICES 64
+#endif
+#define MOON_GAMEPAD_LATENCY_BUCKETS 24
+// Defaults for the device filter; environment variables of the same names
+// override them at runtime.
+#ifndef MOON_GAMEPAD_SYSFS_INPUT_DIR
+#define MOON_GAMEPAD_SYSFS_INPUT_DIR "/sys/class/input"
+#endif
+#ifndef MOON_GAMEPAD_UDEV_DATA_DIR
+#define MOON_GAMEPAD_UDEV_DATA_DIR "/run/udev/data"
+#endif
 #endif
 
 #if defined(_WIN32)
@@ -455,27 +493,117 @@ typedef struct mac_backend_state_t {
 // Shared queue
 // -----------------------------------------------------------------------------
 
+#if defined(__APPLE__) || defined(__linux__)
+// Producers may run on another thread: the macOS run loop, or on Linux the
+// low-latency reader, the FF scheduler or a Gil sharing the backend. macOS
+// always locks; Linux only once one of those exists (backend_set_locked).
+#define MOON_GAMEPAD_QUEUE_LOCKED 1
+#endif
+
 typedef struct moon_gamepad_queue_t {
   moon_gamepad_event_t *buf;
   uint32_t cap;
   uint32_t head;
   uint32_t tail;
   uint32_t len;
-#if defined(__APPLE__)
+  // Events parked in per-device side queues that share this queue's wakeup.
+  uint32_t ext_len;
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
   pthread_mutex_t mu;
   pthread_cond_t cv;
+  // Whether mu is taken; only changed while no other thread can reach the queue.
+  int locked;
+#endif
+#if defined(__APPLE__) || defined(__linux__)
+  // Readable while the queue is non-empty (eventfd on Linux, self-pipe on macOS).
+  int notify_rd;
+  int notify_wr;
 #endif
 } moon_gamepad_queue_t;
 
-static void queue_init(moon_gamepad_queue_t *q, uint32_t cap) {
+#if defined(__APPLE__) || defined(__linux__)
+static void queue_notify_open(moon_gamepad_queue_t *q) {
+  q->notify_rd = -1;
+  q->notify_wr = -1;
+#if defined(__linux__)
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  q->notify_rd = fd;
+  q->notify_wr = fd;
+#else
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return;
+  }
+  for (int i = 0; i < 2; i++) {
+    (void)fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    (void)fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+  }
+  q->notify_rd = fds[0];
+  q->notify_wr = fds[1];
+#endif
+}
+
+static void queue_notify_close(moon_gamepad_queue_t *q) {
+  if (q->notify_rd >= 0) {
+    close(q->notify_rd);
+  }
+  if (q->notify_wr >= 0 && q->notify_wr != q->notify_rd) {
+    close(q->notify_wr);
+  }
+  q->notify_rd = -1;
+  q->notify_wr = -1;
+}
+
+static void queue_notify_set(moon_gamepad_queue_t *q) {
+  if (q->notify_wr < 0) {
+    return;
+  }
+#if defined(__linux__)
+  uint64_t one = 1;
+  (void)write(q->notify_wr, &one, sizeof(one));
+#else
+  uint8_t one = 1;
+  (void)write(q->notify_wr, &one, sizeof(one));
+#endif
+}
+
+static void queue_notify_clear(moon_gamepad_queue_t *q) {
+  if (q->notify_rd < 0) {
+    return;
+  }
+  uint64_t drain[8];
+  while (read(q->notify_rd, drain, sizeof(drain)) > 0) {
+  }
+}
+#endif
+
+// A queue without its own wakeup fd (per-device side queues).
+static void queue_init_plain(moon_gamepad_queue_t *q, uint32_t cap) {
   q->buf = (moon_gamepad_event_t *)calloc((size_t)cap, sizeof(moon_gamepad_event_t));
   q->cap = cap;
   q->head = 0;
   q->tail = 0;
   q->len = 0;
-#if defined(__APPLE__)
+  q->ext_len = 0;
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
   pthread_mutex_init(&q->mu, NULL);
   pthread_cond_init(&q->cv, NULL);
+#if defined(__APPLE__)
+  q->locked = 1;
+#else
+  q->locked = 0;
+#endif
+#endif
+#if defined(__APPLE__) || defined(__linux__)
+  q->notify_rd = -1;
+  q->notify_wr = -1;
+#endif
+}
+
+static void queue_init(moon_gamepad_queue_t *q, uint32_t cap) {
+  queue_init_plain(q, cap);
+#if defined(__APPLE__) || defined(__linux__)
+  queue_notify_open(q);
 #endif
 }
 
@@ -484,26 +612,49 @@ static void queue_free(moon_gamepad_queue_t *q) {
     free(q->buf);
     q->buf = NULL;
   }
-#if defined(__APPLE__)
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
   pthread_cond_destroy(&q->cv);
   pthread_mutex_destroy(&q->mu);
+#endif
+#if defined(__APPLE__) || defined(__linux__)
+  queue_notify_close(q);
 #endif
   q->cap = 0;
   q->head = q->tail = q->len = 0;
+  q->ext_len = 0;
+}
+
+// Takes q->mu when the queue is locked. The result goes to queue_unlock, so
+// the pair stays balanced whatever the flag does in between.
+static int queue_lock(moon_gamepad_queue_t *q) {
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  if (q->locked) {
+    pthread_mutex_lock(&q->mu);
+    return 1;
+  }
+#endif
+  (void)q;
+  return 0;
+}
+
+static void queue_unlock(moon_gamepad_queue_t *q, int held) {
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  if (held) {
+    pthread_mutex_unlock(&q->mu);
+  }
+#endif
+  (void)q;
+  (void)held;
 }
 
 static uint32_t queue_len(moon_gamepad_queue_t *q) {
   if (q == NULL) {
     return 0;
   }
-#if defined(__APPLE__)
-  pthread_mutex_lock(&q->mu);
-  uint32_t out = q->len;
-  pthread_mutex_unlock(&q->mu);
+  int held = queue_lock(q);
+  uint32_t out = q->len + q->ext_len;
+  queue_unlock(q, held);
   return out;
-#else
-  return q->len;
-#endif
 }
 
 static int64_t now_ms(void) {
@@ -564,9 +715,7 @@ static void queue_push(moon_gamepad_queue_t *q, moon_gamepad_event_t ev) {
   if (q->buf == NULL || q->cap == 0) {
     return;
   }
-#if defined(__APPLE__)
-  pthread_mutex_lock(&q->mu);
-#endif
+  int held = queue_lock(q);
   if (q->len == q->cap) {
     // Grow the queue instead of dropping events (gilrs-core uses an unbounded channel).
     if (!queue_grow(q)) {
@@ -578,47 +727,148 @@ static void queue_push(moon_gamepad_queue_t *q, moon_gamepad_event_t ev) {
   q->buf[q->tail] = ev;
   q->tail = (q->tail + 1) % q->cap;
   q->len++;
-#if defined(__APPLE__)
-  pthread_cond_signal(&q->cv);
-  pthread_mutex_unlock(&q->mu);
+#if defined(__APPLE__) || defined(__linux__)
+  if (q->len + q->ext_len == 1) {
+    queue_notify_set(q);
+  }
 #endif
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  if (held) {
+    pthread_cond_signal(&q->cv);
+  }
+#endif
+  queue_unlock(q, held);
 }
 
 static int queue_pop(moon_gamepad_queue_t *q, moon_gamepad_event_t *out) {
   if (q->buf == NULL || q->cap == 0 || out == NULL) {
     return 0;
   }
-#if defined(__APPLE__)
-  pthread_mutex_lock(&q->mu);
-#endif
+  int held = queue_lock(q);
   if (q->len == 0) {
-#if defined(__APPLE__)
-    pthread_mutex_unlock(&q->mu);
-#endif
+    queue_unlock(q, held);
     return 0;
   }
   *out = q->buf[q->head];
   q->head = (q->head + 1) % q->cap;
   q->len--;
-#if defined(__APPLE__)
-  pthread_mutex_unlock(&q->mu);
+#if defined(__APPLE__) || defined(__linux__)
+  if (q->len + q->ext_len == 0) {
+    queue_notify_clear(q);
+  }
 #endif
+  queue_unlock(q, held);
   return 1;
 }
 
+static int queue_peek(moon_gamepad_queue_t *q, moon_gamepad_event_t *out) {
+  int ok = 0;
+  int held = queue_lock(q);
+  if (q->buf != NULL && q->len != 0) {
+    *out = q->buf[q->head];
+    ok = 1;
+  }
+  queue_unlock(q, held);
+  return ok;
+}
+
+// Finds the oldest event for `id`; returns its offset from head or -1.
+static int32_t queue_find_id(moon_gamepad_queue_t *q, uint32_t id, moon_gamepad_event_t *out) {
+  int32_t found = -1;
+  int held = queue_lock(q);
+  for (uint32_t k = 0; q->buf != NULL && k < q->len; k++) {
+    uint32_t at = (q->head + k) % q->cap;
+    if (q->buf[at].id == id) {
+      *out = q->buf[at];
+      found = (int32_t)k;
+      break;
+    }
+  }
+  queue_unlock(q, held);
+  return found;
+}
+
+// Removes the event `k` slots after head, keeping the relative order of the rest.
+// Only the consumer removes, so an offset from queue_find_id stays valid.
+static void queue_remove_at(moon_gamepad_queue_t *q, uint32_t k) {
+  int held = queue_lock(q);
+  if (k < q->len) {
+    for (uint32_t j = k; j > 0; j--) {
+      q->buf[(q->head + j) % q->cap] = q->buf[(q->head + j - 1) % q->cap];
+    }
+    q->head = (q->head + 1) % q->cap;
+    q->len--;
+#if defined(__APPLE__) || defined(__linux__)
+    if (q->len + q->ext_len == 0) {
+      queue_notify_clear(q);
+    }
+#endif
+  }
+  queue_unlock(q, held);
+}
+
+// Moves every event for `id` into `out` (room for q->len), keeping the order
+// of what moves and of what stays. With `keep_count` the moved events stay
+// counted in ext_len, so the queue's wakeup does not flicker. Consumer only.
+static uint32_t queue_extract_id(moon_gamepad_queue_t *q, uint32_t id, moon_gamepad_event_t *out, int keep_count) {
+  uint32_t moved = 0;
+  int held = queue_lock(q);
+  uint32_t kept = 0;
+  for (uint32_t k = 0; q->buf != NULL && k < q->len; k++) {
+    moon_gamepad_event_t ev = q->buf[(q->head + k) % q->cap];
+    if (ev.id == id) {
+      out[moved++] = ev;
+    } else {
+      q->buf[(q->head + kept++) % q->cap] = ev;
+    }
+  }
+  if (moved != 0) {
+    q->len = kept;
+    q->tail = (q->head + kept) % q->cap;
+    if (keep_count) {
+      q->ext_len += moved;
+    }
+#if defined(__APPLE__) || defined(__linux__)
+    if (q->len + q->ext_len == 0) {
+      queue_notify_clear(q);
+    }
+#endif
+  }
+  queue_unlock(q, held);
+  return moved;
+}
+
+static void queue_ext_adjust(moon_gamepad_queue_t *q, int delta) {
+  int held = queue_lock(q);
+  q->ext_len = (uint32_t)((int64_t)q->ext_len + delta);
+#if defined(__APPLE__) || defined(__linux__)
+  if (delta > 0 && q->len + q->ext_len == 1) {
+    queue_notify_set(q);
+  } else if (q->len + q->ext_len == 0) {
+    queue_notify_clear(q);
+  }
+#endif
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  if (held) {
+    pthread_cond_signal(&q->cv);
+  }
+#endif
+  queue_unlock(q, held);
+}
+
 #if defined(__APPLE__)
 static void queue_wait_nonempty(moon_gamepad_queue_t *q, int32_t timeout_ms) {
   if (q == NULL) {
     return;
   }
   pthread_mutex_lock(&q->mu);
-  if (q->len != 0 || timeout_ms == 0) {
+  if (q->len + q->ext_len != 0 || timeout_ms == 0) {
     pthread_mutex_unlock(&q->mu);
     return;
   }
 
   if (timeout_ms < 0) {
-    while (q->len == 0) {
+    while (q->len + q->ext_len == 0) {
       pthread_cond_wait(&q->cv, &q->mu);
     }
     pthread_mutex_unlock(&q->mu);
@@ -631,7 +881,7 @@ static void queue_wait_nonempty(moon_gamepad_queue_t *q, int32_t timeout_ms) {
   ts.tv_sec += (time_t)(timeout_ms / 1000) + (time_t)(nsec / 1000000000LL);
   ts.tv_nsec = (long)(nsec % 1000000000LL);
 
-  while (q->len == 0) {
+  while (q->len + q->ext_len == 0) {
     int rc = pthread_cond_timedwait(&q->cv, &q->mu, &ts);
     if (rc == ETIMEDOUT) {
       break;
@@ -641,6 +891,46 @@ static void queue_wait_nonempty(moon_gamepad_queue_t *q, int32_t timeout_ms) {
 }
 #endif
 
+// -----------------------------------------------------------------------------
+// Subscribers
+// -----------------------------------------------------------------------------
+
+// One backend fans decoded events out to every subscriber queue. Private
+// backends have exactly one subscriber; the shared backend has one per owner.
+#define MOON_GAMEPAD_MAX_SUBSCRIBERS 16
+#define MOON_GAMEPAD_RUMBLE_SLOTS 64
+// One side queue per device the backend can open; past this many targeted
+// devices, pop_for falls back to scanning the lanes.
+#if defined(MOON_GAMEPAD_LINUX_MAX_DEVICES)
+#define MOON_GAMEPAD_DEV_QUEUES MOON_GAMEPAD_LINUX_MAX_DEVICES
+#else
+#define MOON_GAMEPAD_DEV_QUEUES 64
+#endif
+
+typedef struct moon_gamepad_subscriber_t {
+  // Bulk lane (axis and button-value changes); owns the wakeup fd.
+  moon_gamepad_queue_t q;
+  // High-priority lane (connect, disconnect, button edges).
+  moon_gamepad_queue_t hi;
+  int ready_fd;
+  // Arrival order stamped into event.pad so side queues can be merged back.
+  uint32_t seq;
+  // Side queues keyed by device id, created by the first targeted pop for
+  // the device. While dev_stray is set the lanes may still hold events for
+  // it; otherwise new ones go straight to the side queue when per_device.
+  int per_device;
+  uint32_t dev_ids[MOON_GAMEPAD_DEV_QUEUES];
+  moon_gamepad_queue_t *dev_q[MOON_GAMEPAD_DEV_QUEUES];
+  uint8_t dev_stray[MOON_GAMEPAD_DEV_QUEUES];
+  uint32_t dev_len;
+  // Last rumble request per device id; the device plays the sum over subscribers.
+  uint32_t rumble_ids[MOON_GAMEPAD_RUMBLE_SLOTS];
+  uint16_t rumble_strong[MOON_GAMEPAD_RUMBLE_SLOTS];
+  uint16_t rumble_weak[MOON_GAMEPAD_RUMBLE_SLOTS];
+  int64_t rumble_until_ms[MOON_GAMEPAD_RUMBLE_SLOTS];
+  uint32_t rumble_len;
+} moon_gamepad_subscriber_t;
+
 // -----------------------------------------------------------------------------
 // Backend
 // -----------------------------------------------------------------------------
@@ -653,43 +943,285 @@ typedef struct linux_disconnected_entry_t {
 } linux_disconnected_entry_t;
 #endif
 
+#if defined(__linux__)
+typedef struct linux_uring_t linux_uring_t;
+
+// What the device currently holds in its rumble slot, before any software
+// gain, so unchanged requests can skip the EVIOCSFF upload and, while
+// playing, the EV_FF write too.
+typedef struct linux_ff_cache_t {
+  uint16_t strong;
+  uint16_t weak;
+  int32_t length_ms;
+  // When the running replay ends on the device; ff_until_ms is the logical end.
+  int64_t replay_end_ms;
+} linux_ff_cache_t;
+
+// Syscall accounting for the FF path.
+typedef struct linux_ff_stats_t {
+  uint32_t uploads;
+  uint32_t plays;
+  uint32_t stops;
+  uint32_t refreshes;
+  uint32_t skipped;
+  uint32_t offloads;
+  uint32_t evictions;
+} linux_ff_stats_t;
+
+// EV_FF capabilities that decide how an effect can be handed to the driver.
+#define MOON_GAMEPAD_FF_CAP_RUMBLE 1
+#define MOON_GAMEPAD_FF_CAP_PERIODIC 2
+#define MOON_GAMEPAD_FF_CAP_RAMP 4
+#define MOON_GAMEPAD_FF_CAP_GAIN 8
+
+// One base effect in kernel terms. Levels are absolute u16 magnitudes.
+typedef struct linux_ff_offload_req_t {
+  int32_t strong;
+  uint16_t magnitude;
+  int32_t length_ms;
+  int32_t delay_ms;
+  int32_t count;
+  int32_t attack_ms;
+  uint16_t attack_level;
+  int32_t fade_ms;
+  uint16_t fade_level;
+} linux_ff_offload_req_t;
+
+// An effect uploaded whole (envelope, delay, repeats) and played by the
+// driver, keyed by the subscriber and its MoonBit Effect token, since every
+// Gil on a shared backend numbers its effects from 1. Slots stay resident after a
+// stop, so replaying the same effect is a single EV_FF write. The device's
+// EVIOCGEFFECTS capacity, less the rumble slot in ff_id that carries the
+// software mix, bounds how many are used.
+#ifndef MOON_GAMEPAD_FF_SLOT_MAX
+#define MOON_GAMEPAD_FF_SLOT_MAX 16
+#endif
+typedef struct linux_ff_offload_t {
+  uint8_t used;
+  uint8_t playing;
+  int16_t id;
+  const moon_gamepad_subscriber_t *sub;
+  int32_t token;
+  uint32_t last_use;
+  linux_ff_offload_req_t req;
+} linux_ff_offload_t;
+
+// One base effect on one device, as posted to the FF scheduler thread. Times
+// are ms on the moon_gamepad_now_ms clock; end_ms is 0 for no end.
+#ifndef MOON_GAMEPAD_FF_SCHED_MAX
+#define MOON_GAMEPAD_FF_SCHED_MAX 256
+#endif
+#define MOON_GAMEPAD_FF_SCHED_FIELDS 12
+typedef struct linux_ff_sched_rec_t {
+  moon_gamepad_subscriber_t *sub;
+  uint32_t id;
+  uint8_t strong;
+  uint16_t magnitude;
+  double attenuation;
+  int64_t start_ms;
+  int64_t end_ms;
+  int64_t after_ms;
+  int64_t play_for_ms;
+  int64_t with_delay_ms;
+  int64_t attack_ms;
+  double attack_level;
+  int64_t fade_ms;
+  double fade_level;
+} linux_ff_sched_rec_t;
+
+// Streamed amplitude samples for one subscriber and device, consumed by the
+// scheduler thread at the stream's sample rate. At most LATENCY_MS of
+// samples are queued; older ones are dropped to make room. `ending` is set
+// by an end-of-stream push, so running dry then is not an underrun.
+#ifndef MOON_GAMEPAD_FF_STREAM_MAX
+#define MOON_GAMEPAD_FF_STREAM_MAX 4
+#endif
+#define MOON_GAMEPAD_FF_STREAM_CAP 4096
+#define MOON_GAMEPAD_FF_STREAM_LATENCY_MS 250
+typedef struct linux_ff_stream_t {
+  uint8_t used;
+  uint8_t active;
+  uint8_t ending;
+  moon_gamepad_subscriber_t *sub;
+  uint32_t id;
+  int32_t rate;
+  uint32_t head;
+  uint32_t len;
+  // Fractional samples owed since the last step, and that step's time.
+  double due;
+  int64_t last_ns;
+  uint16_t level;
+  uint32_t underruns;
+  uint32_t dropped;
+  uint32_t played;
+  uint16_t ring[MOON_GAMEPAD_FF_STREAM_CAP];
+} linux_ff_stream_t;
+
+// One subscriber's mixed level on one device for a scheduler step.
+#define MOON_GAMEPAD_FF_SCHED_TARGETS (MOON_GAMEPAD_FF_SCHED_MAX + MOON_GAMEPAD_FF_STREAM_MAX)
+typedef struct linux_ff_sched_target_t {
+  moon_gamepad_subscriber_t *sub;
+  uint32_t id;
+  double strong;
+  double weak;
+} linux_ff_sched_target_t;
+
+// Device selection applied before a node is opened. Each non-empty
+// category must match (any entry within it); an empty filter allows all.
+#define MOON_GAMEPAD_FILTER_MAX 16
+typedef struct linux_device_filter_t {
+  char paths[MOON_GAMEPAD_FILTER_MAX][128];
+  uint32_t paths_len;
+  char uuids[MOON_GAMEPAD_FILTER_MAX][33];
+  uint32_t uuids_len;
+  int32_t vendors[MOON_GAMEPAD_FILTER_MAX];
+  int32_t products[MOON_GAMEPAD_FILTER_MAX];
+  uint32_t ids_len;
+  char seats[MOON_GAMEPAD_FILTER_MAX][64];
+  uint32_t seats_len;
+  char tags[MOON_GAMEPAD_FILTER_MAX][64];
+  uint32_t tags_len;
+  // sysfs input class and udev database roots; see linux_filter_parse.
+  char sysfs_dir[128];
+  char udev_dir[128];
+} linux_device_filter_t;
+
+// Test fixture: write ends of the pipes standing in for device nodes, and
+// an in-process stand-in for each pad's FF driver (see linux_ff_upload).
+#define MOON_GAMEPAD_FAKE_MAX_DEVICES 8
+#define MOON_GAMEPAD_FAKE_FF_EFFECTS 32
+typedef struct linux_fake_ff_t {
+  int32_t effects;
+  uint8_t used[MOON_GAMEPAD_FAKE_FF_EFFECTS];
+  int32_t playing[MOON_GAMEPAD_FAKE_FF_EFFECTS];
+  struct ff_effect fx[MOON_GAMEPAD_FAKE_FF_EFFECTS];
+  uint32_t uploads;
+  uint32_t erases;
+  uint32_t plays;
+  uint32_t stops;
+  uint32_t gain_writes;
+  int32_t gain;
+} linux_fake_ff_t;
+
+typedef struct linux_fake_t {
+  int wr[MOON_GAMEPAD_FAKE_MAX_DEVICES];
+  uint32_t len;
+  linux_fake_ff_t ff[MOON_GAMEPAD_FAKE_MAX_DEVICES];
+} linux_fake_t;
+#endif
+
 typedef struct moon_gamepad_backend_t {
-  moon_gamepad_queue_t q;
+  moon_gamepad_subscriber_t *subs[MOON_GAMEPAD_MAX_SUBSCRIBERS];
+  uint32_t subs_len;
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  pthread_mutex_t subs_mu;
+  // Whether subs_mu and the subscribers' queue mutexes are taken.
+  int locked;
+#endif
   int32_t gamepad_count;
+  // Owners of a shared backend; guarded by g_shared_mu.
+  uint32_t shared_refs;
 
 #if defined(__APPLE__)
   mac_backend_state_t mac;
 #endif
 
 #if defined(__linux__)
-  int fds[64];
-  uint32_t fd_ids[64];
-  char paths[64][256];
-  int32_t vendors[64];
-  int32_t products[64];
-  char uuids[64][33];
-  char names[64][256];
-  int32_t axes_codes[64][32];
-  int32_t axes_src[64][32];
-  int32_t axes_value[64][32];
-  uint8_t axes_len[64];
-  int32_t buttons_codes[64][64];
-  int32_t buttons_src[64][64];
-  uint8_t buttons_pressed[64][64];
-  uint8_t buttons_len[64];
-  int32_t axis_info_codes[64][32];
-  int32_t axis_info_min[64][32];
-  int32_t axis_info_max[64][32];
-  int32_t axis_info_deadzone[64][32];
-  uint8_t axis_info_len[64];
-  uint8_t need_resync[64];
-  uint8_t ff_supported[64];
-  uint8_t rw[64];
-  int32_t ff_id[64];
-  int64_t ff_until_ms[64];
+  int fds[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  uint32_t fd_ids[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  char paths[MOON_GAMEPAD_LINUX_MAX_DEVICES][256];
+  int32_t vendors[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  int32_t products[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  char uuids[MOON_GAMEPAD_LINUX_MAX_DEVICES][33];
+  char names[MOON_GAMEPAD_LINUX_MAX_DEVICES][256];
+  int32_t axes_codes[MOON_GAMEPAD_LINUX_MAX_DEVICES][32];
+  int32_t axes_src[MOON_GAMEPAD_LINUX_MAX_DEVICES][32];
+  int32_t axes_value[MOON_GAMEPAD_LINUX_MAX_DEVICES][32];
+  uint8_t axes_len[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  int32_t buttons_codes[MOON_GAMEPAD_LINUX_MAX_DEVICES][64];
+  int32_t buttons_src[MOON_GAMEPAD_LINUX_MAX_DEVICES][64];
+  uint8_t buttons_pressed[MOON_GAMEPAD_LINUX_MAX_DEVICES][64];
+  uint8_t buttons_len[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  int32_t axis_info_codes[MOON_GAMEPAD_LINUX_MAX_DEVICES][32];
+  int32_t axis_info_min[MOON_GAMEPAD_LINUX_MAX_DEVICES][32];
+  int32_t axis_info_max[MOON_GAMEPAD_LINUX_MAX_DEVICES][32];
+  int32_t axis_info_deadzone[MOON_GAMEPAD_LINUX_MAX_DEVICES][32];
+  uint8_t axis_info_len[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  uint8_t need_resync[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  uint8_t ff_supported[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  uint8_t rw[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  int32_t ff_id[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  int64_t ff_until_ms[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  linux_ff_cache_t ff_cache[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  uint8_t ff_caps[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  uint16_t ff_gain[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  linux_ff_offload_t ff_offload[MOON_GAMEPAD_LINUX_MAX_DEVICES][MOON_GAMEPAD_FF_SLOT_MAX];
+  uint8_t ff_slots[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  uint32_t ff_use_clock;
+  linux_ff_stats_t ff_stats;
   linux_disconnected_entry_t *disconnected_head;
   uint32_t fds_len;
   uint32_t next_id;
+  // Readiness: epoll set over device fds, the queue notify fd, hotplug and FF timer.
+  int epoll_fd;
+  int hotplug_fd;
+  int ff_timer_fd;
+  int64_t ff_timer_deadline_ms;
+  // Earliest FF stop or replay refresh across devices, 0 when none.
+  int64_t ff_next_deadline_ms;
+  // Optional io_uring read path; NULL when device fds are serviced via epoll.
+  linux_uring_t *uring;
+  // Optional low-latency reader thread. It busy-polls device fds and holds
+  // reader_mu per sweep; the owning thread takes reader_mu for hotplug,
+  // force feedback, hang-up release and compaction, and every query export
+  // copies the per-device tables under it.
+  pthread_t reader;
+  pthread_mutex_t reader_mu;
+  int reader_running;
+  // Set when the backend is first shared and never cleared: Gils on other
+  // threads may join and poll at any time, so reader_mu is always taken.
+  // Deciding per call on subs_len would race with a join.
+  int reader_shared;
+  int reader_stop;
+  int reader_wake_fd;
+  int32_t reader_cpu;
+  int32_t reader_realtime;
+  int32_t reader_status;
+  uint8_t hung_up[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  // Optional FF scheduler thread, shared by the subscribers that started it.
+  // It mixes their posted records at ff_sched_hz and drives the devices
+  // under reader_mu; ff_sched_mu guards the users, records, streams and the
+  // targets the last step drove.
+  pthread_t ff_sched;
+  pthread_mutex_t ff_sched_mu;
+  int ff_sched_running;
+  int ff_sched_stop;
+  int32_t ff_sched_hz;
+  moon_gamepad_subscriber_t *ff_sched_users[MOON_GAMEPAD_MAX_SUBSCRIBERS];
+  uint32_t ff_sched_users_len;
+  linux_ff_sched_rec_t ff_sched_recs[MOON_GAMEPAD_FF_SCHED_MAX];
+  uint32_t ff_sched_len;
+  linux_ff_sched_target_t ff_sched_driven[MOON_GAMEPAD_FF_SCHED_TARGETS];
+  uint32_t ff_sched_driven_len;
+  linux_ff_stream_t ff_streams[MOON_GAMEPAD_FF_STREAM_MAX];
+  // Kernel timestamp -> decode latency; bucket k counts [2^(k-1), 2^k) us.
+  uint32_t latency_hist[MOON_GAMEPAD_LATENCY_BUCKETS];
+  // Seqlock over axes_value/buttons_pressed (odd = write in progress), so
+  // state_bin can copy them while the reader thread decodes. state_gen is
+  // restamped from state_clock whenever a device's state changes.
+  uint32_t state_seq;
+  uint32_t state_clock;
+  uint32_t state_gen[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  // Background device probing. The probe thread scans into the private
+  // `probe` table and signals probe_fd; the owner adopts the devices.
+  int async_probe;
+  int probe_cancel;
+  int probe_fd;
+  pthread_t probe_thread;
+  struct moon_gamepad_backend_t *probe;
+  linux_device_filter_t filter;
+  // Pipe-backed test pads (moon_gamepad_backend_new_fake_for_test), else NULL.
+  linux_fake_t *fake;
 #endif
 
 #if defined(_WIN32)
@@ -707,6 +1239,269 @@ typedef struct moon_gamepad_backend_t {
 #endif
 } moon_gamepad_backend_t;
 
+// Like queue_lock, for the subscriber list.
+static int backend_subs_lock(moon_gamepad_backend_t *b) {
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  if (b->locked) {
+    pthread_mutex_lock(&b->subs_mu);
+    return 1;
+  }
+#endif
+  (void)b;
+  return 0;
+}
+
+static void backend_subs_unlock(moon_gamepad_backend_t *b, int held) {
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  if (held) {
+    pthread_mutex_unlock(&b->subs_mu);
+  }
+#endif
+  (void)b;
+  (void)held;
+}
+
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+static void subscriber_set_locked(moon_gamepad_subscriber_t *sub, int on) {
+  sub->q.locked = on;
+  sub->hi.locked = on;
+  for (uint32_t i = 0; i < sub->dev_len; i++) {
+    sub->dev_q[i]->locked = on;
+  }
+}
+#endif
+
+// Turns locking of the subscriber list and queues on or off. Callers make
+// sure no other thread can reach them: before a thread starts or the backend
+// is handed out, or after every thread has been joined.
+static void backend_set_locked(moon_gamepad_backend_t *b, int on) {
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  if (b->locked == on) {
+    return;
+  }
+  b->locked = on;
+  for (uint32_t i = 0; i < b->subs_len; i++) {
+    subscriber_set_locked(b->subs[i], on);
+  }
+#else
+  (void)b;
+  (void)on;
+#endif
+}
+
+static int seq_before(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b) < 0;
+}
+
+static int event_is_high_priority(const moon_gamepad_event_t *ev) {
+  return ev->tag == MOON_GAMEPAD_EV_CONNECTED || ev->tag == MOON_GAMEPAD_EV_DISCONNECTED ||
+         ev->tag == MOON_GAMEPAD_EV_BUTTON_PRESSED || ev->tag == MOON_GAMEPAD_EV_BUTTON_RELEASED;
+}
+
+// Returns the side queue slot for `id`, or -1. A new slot starts stray: the
+// lanes may hold older events for the device.
+static int32_t subscriber_dev_slot(moon_gamepad_subscriber_t *sub, uint32_t id, int create) {
+  for (uint32_t i = 0; i < sub->dev_len; i++) {
+    if (sub->dev_ids[i] == id) {
+      return (int32_t)i;
+    }
+  }
+  if (!create || sub->dev_len >= MOON_GAMEPAD_DEV_QUEUES) {
+    return -1;
+  }
+  moon_gamepad_queue_t *q = (moon_gamepad_queue_t *)calloc(1, sizeof(moon_gamepad_queue_t));
+  if (q == NULL) {
+    return -1;
+  }
+  queue_init_plain(q, 64);
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  q->locked = sub->q.locked;
+#endif
+  sub->dev_ids[sub->dev_len] = id;
+  sub->dev_q[sub->dev_len] = q;
+  sub->dev_stray[sub->dev_len] = 1;
+  return (int32_t)sub->dev_len++;
+}
+
+// Called under subs_mu. Only the consumer moves events out of the lanes, so
+// an event for a stray device goes to a lane until the next targeted pop.
+static void subscriber_push(moon_gamepad_subscriber_t *sub, moon_gamepad_event_t ev) {
+  ev.pad = ++sub->seq;
+  int32_t slot = subscriber_dev_slot(sub, ev.id, 0);
+  if (slot >= 0) {
+    if (sub->per_device && !sub->dev_stray[slot]) {
+      queue_push(sub->dev_q[slot], ev);
+      queue_ext_adjust(&sub->q, 1);
+      return;
+    }
+    sub->dev_stray[slot] = 1;
+  }
+  if (event_is_high_priority(&ev)) {
+    queue_push(&sub->hi, ev);
+    queue_ext_adjust(&sub->q, 1);
+    return;
+  }
+  queue_push(&sub->q, ev);
+}
+
+static void backend_emit(moon_gamepad_backend_t *b, moon_gamepad_event_t ev) {
+  int held = backend_subs_lock(b);
+  for (uint32_t i = 0; i < b->subs_len; i++) {
+    subscriber_push(b->subs[i], ev);
+  }
+  backend_subs_unlock(b, held);
+}
+
+// True if the bulk lane holds an older event that `hi` must not overtake: one
+// with the same device and code, or any event of the device when `hi` is a
+// connect/disconnect.
+static int queue_blocks_overtake(moon_gamepad_queue_t *bulk, const moon_gamepad_event_t *hi) {
+  int barrier = hi->tag == MOON_GAMEPAD_EV_CONNECTED || hi->tag == MOON_GAMEPAD_EV_DISCONNECTED;
+  int blocked = 0;
+  int held = queue_lock(bulk);
+  for (uint32_t k = 0; bulk->buf != NULL && k < bulk->len; k++) {
+    const moon_gamepad_event_t *e = &bulk->buf[(bulk->head + k) % bulk->cap];
+    if (!seq_before(e->pad, hi->pad)) {
+      break;
+    }
+    if (e->id == hi->id && (barrier || e->code == hi->code)) {
+      blocked = 1;
+      break;
+    }
+  }
+  queue_unlock(bulk, held);
+  return blocked;
+}
+
+// Merge policy: the high-priority lane (connect, disconnect, button edges) is
+// served first unless its head would overtake an older bulk event for the same
+// device and code (or, for connection changes, any older event of the device).
+// Otherwise lanes and per-device side queues are merged by arrival sequence, so
+// per-code order is always preserved.
+static int subscriber_pop(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub, moon_gamepad_event_t *out) {
+  moon_gamepad_event_t best;
+  moon_gamepad_queue_t *from = NULL;
+  if (queue_peek(&sub->hi, &best) && !queue_blocks_overtake(&sub->q, &best)) {
+    from = &sub->hi;
+  } else {
+    int held = backend_subs_lock(b);
+    if (queue_peek(&sub->q, &best)) {
+      from = &sub->q;
+    }
+    moon_gamepad_event_t head;
+    if (queue_peek(&sub->hi, &head) && (from == NULL || seq_before(head.pad, best.pad))) {
+      best = head;
+      from = &sub->hi;
+    }
+    for (uint32_t i = 0; i < sub->dev_len; i++) {
+      if (queue_peek(sub->dev_q[i], &head) && (from == NULL || seq_before(head.pad, best.pad))) {
+        best = head;
+        from = sub->dev_q[i];
+      }
+    }
+    backend_subs_unlock(b, held);
+  }
+  if (from == NULL || !queue_pop(from, out)) {
+    return 0;
+  }
+  if (from != &sub->q) {
+    queue_ext_adjust(&sub->q, -1);
+  }
+  return 1;
+}
+
+#if defined(__linux__)
+// Drops everything queued for `sub`, in every lane.
+static void subscriber_discard(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub) {
+  moon_gamepad_event_t ev;
+  while (subscriber_pop(b, sub, &ev)) {
+  }
+}
+#endif
+
+// Moves the device's events from both lanes onto the tail of its side queue,
+// merged by arrival sequence; anything already there is older. Called under
+// subs_mu, so no producer pushes meanwhile.
+static void subscriber_gather(moon_gamepad_subscriber_t *sub, int32_t slot) {
+  uint32_t cap = queue_len(&sub->q) + queue_len(&sub->hi);
+  if (cap == 0) {
+    sub->dev_stray[slot] = 0;
+    return;
+  }
+  moon_gamepad_event_t *tmp = (moon_gamepad_event_t *)malloc((size_t)cap * sizeof(moon_gamepad_event_t));
+  if (tmp == NULL) {
+    return;
+  }
+  uint32_t id = sub->dev_ids[slot];
+  uint32_t nq = queue_extract_id(&sub->q, id, tmp, 1);
+  uint32_t nh = queue_extract_id(&sub->hi, id, tmp + nq, 0);
+  moon_gamepad_queue_t *dq = sub->dev_q[slot];
+  for (uint32_t i = 0, j = nq; i < nq || j < nq + nh;) {
+    if (j == nq + nh || (i < nq && seq_before(tmp[i].pad, tmp[j].pad))) {
+      queue_push(dq, tmp[i++]);
+    } else {
+      queue_push(dq, tmp[j++]);
+    }
+  }
+  free(tmp);
+  sub->dev_stray[slot] = 0;
+}
+
+// Targeted pops keep strict arrival order for the device across lanes. The
+// first one for a device gathers its events into a side queue in one pass,
+// so draining a device costs O(queued) in total instead of a scan per event.
+// Past MOON_GAMEPAD_DEV_QUEUES devices each pop scans and shifts the lanes,
+// which is O(queued) per event.
+static int subscriber_pop_for(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub, uint32_t id,
+                              moon_gamepad_event_t *out) {
+  int held = backend_subs_lock(b);
+  int32_t slot = subscriber_dev_slot(sub, id, 1);
+  int gathered = 0;
+  if (slot >= 0) {
+    if (sub->dev_stray[slot]) {
+      subscriber_gather(sub, slot);
+    }
+    gathered = !sub->dev_stray[slot];
+  }
+  backend_subs_unlock(b, held);
+  if (gathered) {
+    // Whatever reached the lanes since is newer than the side queue.
+    if (!queue_pop(sub->dev_q[slot], out)) {
+      return 0;
+    }
+    queue_ext_adjust(&sub->q, -1);
+    return 1;
+  }
+  moon_gamepad_event_t best;
+  moon_gamepad_event_t ev;
+  moon_gamepad_queue_t *from = NULL;
+  int32_t at = queue_find_id(&sub->q, id, &best);
+  if (at >= 0) {
+    from = &sub->q;
+  }
+  int32_t hi_at = queue_find_id(&sub->hi, id, &ev);
+  if (hi_at >= 0 && (from == NULL || seq_before(ev.pad, best.pad))) {
+    best = ev;
+    from = &sub->hi;
+    at = hi_at;
+  }
+  moon_gamepad_queue_t *dq = slot >= 0 ? sub->dev_q[slot] : NULL;
+  if (dq != NULL && queue_peek(dq, &ev) && (from == NULL || seq_before(ev.pad, best.pad))) {
+    best = ev;
+    from = dq;
+    at = 0;
+  }
+  if (from == NULL) {
+    return 0;
+  }
+  *out = best;
+  queue_remove_at(from, (uint32_t)at);
+  if (from != &sub->q) {
+    queue_ext_adjust(&sub->q, -1);
+  }
+  return 1;
+}
+
 // Internal logical codes (must match native_ev_codes.mbt).
 enum {
   CODE_BTN_SOUTH = 0,
@@ -1165,7 +1960,7 @@ static void device_matching_cb(void *ctx, IOReturn res, void *sender, IOHIDDevic
   for (uint32_t i = 0; i < b->mac.devices_len; i++) {
     if (b->mac.devices[i].entry_id == entry_id && b->mac.devices[i].connected) {
       moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_CONNECTED, b->mac.devices[i].id, 0, 0, 0.0, now_ms()};
-      queue_push(&b->q, ev);
+      backend_emit(b, ev);
       return;
     }
   }
@@ -1190,7 +1985,7 @@ static void device_matching_cb(void *ctx, IOReturn res, void *sender, IOHIDDevic
   mac_fill_device_info(d, device);
   b->gamepad_count = (int32_t)mac_connected_count(b);
   moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_CONNECTED, d->id, 0, 0, 0.0, now_ms()};
-  queue_push(&b->q, ev);
+  backend_emit(b, ev);
 }
 
 static void device_removal_cb(void *ctx, IOReturn res, void *sender, IOHIDDeviceRef device) {
@@ -1218,7 +2013,7 @@ static void device_removal_cb(void *ctx, IOReturn res, void *sender, IOHIDDevice
   d->connected = 0;
   b->gamepad_count = (int32_t)mac_connected_count(b);
   moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_DISCONNECTED, id, 0, 0, 0.0, now_ms()};
-  queue_push(&b->q, ev);
+  backend_emit(b, ev);
 }
 
 static void input_value_cb(void *ctx, IOReturn res, void *sender, IOHIDValueRef value) {
@@ -1254,7 +2049,7 @@ static void input_value_cb(void *ctx, IOReturn res, void *sender, IOHIDValueRef
     uint32_t code = mac_hid_code(page, usage);
     int32_t v = (int32_t)IOHIDValueGetIntegerValue(value);
     moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_AXIS_CHANGED, id, code, 0, (double)v, t};
-    queue_push(&b->q, ev);
+    backend_emit(b, ev);
     return;
   }
 
@@ -1268,7 +2063,7 @@ static void input_value_cb(void *ctx, IOReturn res, void *sender, IOHIDValueRef
     ev.pad = 0;
     ev.value = (v != 0) ? 1.0 : 0.0;
     ev.time_ms = t;
-    queue_push(&b->q, ev);
+    backend_emit(b, ev);
     return;
   }
 
@@ -1288,8 +2083,8 @@ static void input_value_cb(void *ctx, IOReturn res, void *sender, IOHIDValueRef
       uint32_t code_y = mac_hid_code(page, 0x3Au);
       moon_gamepad_event_t ex = {MOON_GAMEPAD_EV_AXIS_CHANGED, id, code_x, 0, x, t};
       moon_gamepad_event_t ey = {MOON_GAMEPAD_EV_AXIS_CHANGED, id, code_y, 0, y, t};
-      queue_push(&b->q, ex);
-      queue_push(&b->q, ey);
+      backend_emit(b, ex);
+      backend_emit(b, ey);
       return;
   }
 }
@@ -1559,7 +2354,7 @@ static uint32_t map_linux_abs(uint16_t code) {
 }
 
 static int linux_button_slot_by_code(moon_gamepad_backend_t *b, uint32_t idx, uint32_t code) {
-  if (b == NULL || idx >= 64) {
+  if (b == NULL || idx >= MOON_GAMEPAD_LINUX_MAX_DEVICES) {
     return -1;
   }
   uint8_t len = b->buttons_len[idx];
@@ -1572,7 +2367,7 @@ static int linux_button_slot_by_code(moon_gamepad_backend_t *b, uint32_t idx, ui
 }
 
 static int linux_axis_slot_by_code(moon_gamepad_backend_t *b, uint32_t idx, uint32_t code) {
-  if (b == NULL || idx >= 64) {
+  if (b == NULL || idx >= MOON_GAMEPAD_LINUX_MAX_DEVICES) {
     return -1;
   }
   uint8_t len = b->axes_len[idx];
@@ -1585,7 +2380,7 @@ static int linux_axis_slot_by_code(moon_gamepad_backend_t *b, uint32_t idx, uint
 }
 
 static void linux_push_button_cap(moon_gamepad_backend_t *b, uint32_t idx, uint32_t code, uint16_t src) {
-  if (b == NULL || idx >= 64 || code == UINT32_MAX) {
+  if (b == NULL || idx >= MOON_GAMEPAD_LINUX_MAX_DEVICES || code == UINT32_MAX) {
     return;
   }
   int pos = linux_button_slot_by_code(b, idx, code);
@@ -1604,7 +2399,7 @@ static void linux_push_button_cap(moon_gamepad_backend_t *b, uint32_t idx, uint3
 }
 
 static void linux_push_axis_cap(moon_gamepad_backend_t *b, uint32_t idx, uint32_t code, uint16_t src) {
-  if (b == NULL || idx >= 64 || code == UINT32_MAX) {
+  if (b == NULL || idx >= MOON_GAMEPAD_LINUX_MAX_DEVICES || code == UINT32_MAX) {
     return;
   }
   int pos = linux_axis_slot_by_code(b, idx, code);
@@ -1624,7 +2419,7 @@ static void linux_push_axis_cap(moon_gamepad_backend_t *b, uint32_t idx, uint32_
 
 static void linux_upsert_axis_info(moon_gamepad_backend_t *b, uint32_t idx, uint32_t code, int32_t minv,
                                    int32_t maxv, int32_t deadzone) {
-  if (b == NULL || idx >= 64 || code == UINT32_MAX) {
+  if (b == NULL || idx >= MOON_GAMEPAD_LINUX_MAX_DEVICES || code == UINT32_MAX) {
     return;
   }
   uint8_t len = b->axis_info_len[idx];
@@ -1667,13 +2462,24 @@ static const linux_code_map_t LINUX_AXIS_MAPS[] = {
     {ABS_HAT0X, CODE_AXIS_DPADX}, {ABS_HAT0Y, CODE_AXIS_DPADY},
 };
 
+static void linux_state_begin(moon_gamepad_backend_t *b) {
+  __atomic_add_fetch(&b->state_seq, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void linux_state_end(moon_gamepad_backend_t *b, uint32_t idx) {
+  b->state_gen[idx] = ++b->state_clock;
+  __atomic_add_fetch(&b->state_seq, 1, __ATOMIC_RELEASE);
+}
+
 static void linux_resync_device_state(moon_gamepad_backend_t *b, uint32_t idx, int emit_events) {
-  if (b == NULL || idx >= 64) {
+  if (b == NULL || idx >= MOON_GAMEPAD_LINUX_MAX_DEVICES) {
     return;
   }
   if (b->fds[idx] < 0) {
     return;
   }
+  linux_state_begin(b);
   unsigned long keybit[NBITS(KEY_MAX)];
   memset(keybit, 0, sizeof(keybit));
   (void)ioctl(b->fds[idx], EVIOCGKEY(sizeof(keybit)), keybit);
@@ -1698,7 +2504,7 @@ static void linux_resync_device_state(moon_gamepad_backend_t *b, uint32_t idx, i
     ev.pad = 0;
     ev.value = pressed ? 1.0 : 0.0;
     ev.time_ms = t;
-    queue_push(&b->q, ev);
+    backend_emit(b, ev);
   }
 
   uint8_t axis_len = b->axes_len[idx];
@@ -1720,12 +2526,13 @@ static void linux_resync_device_state(moon_gamepad_backend_t *b, uint32_t idx, i
     }
     moon_gamepad_event_t ev = {
         MOON_GAMEPAD_EV_AXIS_CHANGED, b->fd_ids[idx], (uint32_t)b->axes_codes[idx][i], 0, (double)new_val, t};
-    queue_push(&b->q, ev);
+    backend_emit(b, ev);
   }
+  linux_state_end(b, idx);
 }
 
 static void linux_collect_device_caps(moon_gamepad_backend_t *b, uint32_t idx, int fd) {
-  if (b == NULL || idx >= 64 || fd < 0) {
+  if (b == NULL || idx >= MOON_GAMEPAD_LINUX_MAX_DEVICES || fd < 0) {
     return;
   }
   b->axes_len[idx] = 0;
@@ -2013,56 +2820,273 @@ static void linux_power_info_from_event_path(const char *event_path, int32_t *ta
   }
 }
 
-static void linux_ff_stop_idx(moon_gamepad_backend_t *b, uint32_t idx) {
-  if (b == NULL || idx >= b->fds_len) {
-    return;
+// A replay is restarted this long before it would run out on the device.
+#define MOON_GAMEPAD_FF_REFRESH_MARGIN_MS 10
+
+// Carrier period for enveloped effects offloaded as FF_PERIODIC.
+#define MOON_GAMEPAD_FF_PERIOD_MS 20
+
+// Every FF request to a device goes through linux_ff_upload (EVIOCSFF),
+// linux_ff_erase (EVIOCRMFF) and linux_ff_write (EV_FF), so the test
+// fixture can play the driver. Upload returns -1 on failure, like ioctl.
+static linux_fake_ff_t *linux_fake_ff(moon_gamepad_backend_t *b, uint32_t idx) {
+  if (b->fake == NULL || idx >= b->fake->len) {
+    return NULL;
   }
-  if (b->fds[idx] < 0) {
-    return;
+  return &b->fake->ff[idx];
+}
+
+static int linux_ff_upload(moon_gamepad_backend_t *b, uint32_t idx, struct ff_effect *e) {
+  linux_fake_ff_t *f = linux_fake_ff(b, idx);
+  if (f == NULL) {
+    return ioctl(b->fds[idx], EVIOCSFF, e);
   }
-  if (!b->rw[idx] || !b->ff_supported[idx] || b->ff_id[idx] < 0) {
-    b->ff_until_ms[idx] = 0;
-    return;
+  if (e->id < 0) {
+    e->id = -1;
+    for (int32_t k = 0; k < f->effects && e->id < 0; k++) {
+      if (!f->used[k]) {
+        e->id = (int16_t)k;
+      }
+    }
   }
-  struct input_event ie;
-  memset(&ie, 0, sizeof(ie));
-  ie.type = EV_FF;
-  ie.code = (uint16_t)b->ff_id[idx];
-  ie.value = 0;
-  (void)write(b->fds[idx], &ie, sizeof(ie));
-  b->ff_until_ms[idx] = 0;
+  if (e->id < 0 || e->id >= f->effects) {
+    return -1;
+  }
+  f->used[e->id] = 1;
+  f->fx[e->id] = *e;
+  f->uploads++;
+  return 0;
 }
 
-static void linux_ff_remove_idx(moon_gamepad_backend_t *b, uint32_t idx) {
-  if (b == NULL || idx >= b->fds_len) {
+static void linux_ff_erase(moon_gamepad_backend_t *b, uint32_t idx, int id) {
+  linux_fake_ff_t *f = linux_fake_ff(b, idx);
+  if (f == NULL) {
+    (void)ioctl(b->fds[idx], EVIOCRMFF, id);
     return;
   }
-  if (b->fds[idx] < 0) {
-    b->ff_id[idx] = -1;
-    b->ff_until_ms[idx] = 0;
-    return;
+  if (id >= 0 && id < f->effects && f->used[id]) {
+    f->used[id] = 0;
+    f->playing[id] = 0;
+    f->erases++;
   }
-  linux_ff_stop_idx(b, idx);
-  if (!b->rw[idx] || !b->ff_supported[idx] || b->ff_id[idx] < 0) {
+}
+
+// Returns 1 when the whole event was written.
+static int linux_ff_write(moon_gamepad_backend_t *b, uint32_t idx, uint16_t code, int32_t value) {
+  linux_fake_ff_t *f = linux_fake_ff(b, idx);
+  if (f == NULL) {
+    struct input_event ie;
+    memset(&ie, 0, sizeof(ie));
+    ie.type = EV_FF;
+    ie.code = code;
+    ie.value = value;
+    return write(b->fds[idx], &ie, sizeof(ie)) == (ssize_t)sizeof(ie) ? 1 : 0;
+  }
+  if (code == FF_GAIN) {
+    f->gain = value;
+    f->gain_writes++;
+    return 1;
+  }
+  if (code >= f->effects || !f->used[code]) {
+    return 0;
+  }
+  f->playing[code] = value;
+  if (value > 0) {
+    f->plays++;
+  } else {
+    f->stops++;
+  }
+  return 1;
+}
+
+static void linux_ff_stop_idx(moon_gamepad_backend_t *b, uint32_t idx) {
+  if (b == NULL || idx >= b->fds_len) {
+    return;
+  }
+  if (b->fds[idx] < 0) {
+    return;
+  }
+  if (!b->rw[idx] || !b->ff_supported[idx] || b->ff_id[idx] < 0) {
+    b->ff_until_ms[idx] = 0;
+    return;
+  }
+  (void)linux_ff_write(b, idx, (uint16_t)b->ff_id[idx], 0);
+  b->ff_stats.stops++;
+  b->ff_until_ms[idx] = 0;
+  b->ff_cache[idx].replay_end_ms = 0;
+}
+
+static void linux_ff_offload_erase(moon_gamepad_backend_t *b, uint32_t idx, int k);
+
+static void linux_ff_remove_idx(moon_gamepad_backend_t *b, uint32_t idx) {
+  if (b == NULL || idx >= b->fds_len) {
+    return;
+  }
+  memset(&b->ff_cache[idx], 0, sizeof(b->ff_cache[idx]));
+  for (int k = 0; k < MOON_GAMEPAD_FF_SLOT_MAX; k++) {
+    linux_ff_offload_erase(b, idx, k);
+  }
+  if (b->fds[idx] < 0) {
+    b->ff_id[idx] = -1;
+    b->ff_until_ms[idx] = 0;
+    return;
+  }
+  linux_ff_stop_idx(b, idx);
+  if (!b->rw[idx] || !b->ff_supported[idx] || b->ff_id[idx] < 0) {
     b->ff_id[idx] = -1;
     return;
   }
-  (void)ioctl(b->fds[idx], EVIOCRMFF, b->ff_id[idx]);
+  linux_ff_erase(b, idx, b->ff_id[idx]);
   b->ff_id[idx] = -1;
 }
 
-static void linux_ff_tick(moon_gamepad_backend_t *b) {
-  if (b == NULL) {
+// Starts (or restarts) the uploaded effect for one replay length.
+static int linux_ff_play_idx(moon_gamepad_backend_t *b, uint32_t idx, int64_t t) {
+  if (!linux_ff_write(b, idx, (uint16_t)b->ff_id[idx], 1)) {
+    return 0;
+  }
+  b->ff_stats.plays++;
+  b->ff_cache[idx].replay_end_ms = t + (int64_t)b->ff_cache[idx].length_ms;
+  return 1;
+}
+
+// When a request outlives the running replay, the time to restart it.
+static int64_t linux_ff_refresh_at(const moon_gamepad_backend_t *b, uint32_t idx) {
+  const linux_ff_cache_t *c = &b->ff_cache[idx];
+  if (b->ff_until_ms[idx] == 0 || c->replay_end_ms == 0 || b->ff_until_ms[idx] <= c->replay_end_ms) {
+    return 0;
+  }
+  return c->replay_end_ms - MOON_GAMEPAD_FF_REFRESH_MARGIN_MS;
+}
+
+// The next stop or replay refresh due on one device, 0 when none.
+static int64_t linux_ff_deadline_idx(const moon_gamepad_backend_t *b, uint32_t idx) {
+  int64_t deadline = b->ff_until_ms[idx];
+  int64_t refresh = linux_ff_refresh_at(b, idx);
+  if (refresh != 0 && (deadline == 0 || refresh < deadline)) {
+    deadline = refresh;
+  }
+  return deadline;
+}
+
+// Keeps ff_next_deadline_ms exact after one device's deadline moved from
+// `old`. Only a device that held the earliest deadline and gave it up
+// needs a rescan.
+static void linux_ff_deadline_moved(moon_gamepad_backend_t *b, uint32_t idx, int64_t old) {
+  int64_t deadline = linux_ff_deadline_idx(b, idx);
+  if (deadline != 0 && (b->ff_next_deadline_ms == 0 || deadline < b->ff_next_deadline_ms)) {
+    b->ff_next_deadline_ms = deadline;
     return;
   }
-  int64_t t = now_ms();
+  if (old == 0 || old != b->ff_next_deadline_ms || deadline == old) {
+    return;
+  }
+  int64_t next = 0;
+  for (uint32_t i = 0; i < b->fds_len; i++) {
+    int64_t d = linux_ff_deadline_idx(b, i);
+    if (d != 0 && (next == 0 || d < next)) {
+      next = d;
+    }
+  }
+  b->ff_next_deadline_ms = next;
+}
+
+// Sweeps the devices only once the earliest deadline has passed, and finds
+// the next one in the same pass.
+static void linux_ff_tick(moon_gamepad_backend_t *b, int64_t t) {
+  if (b == NULL || b->ff_next_deadline_ms == 0 || t < b->ff_next_deadline_ms) {
+    return;
+  }
+  int64_t next = 0;
   for (uint32_t i = 0; i < b->fds_len; i++) {
     if (b->ff_until_ms[i] != 0 && t >= b->ff_until_ms[i]) {
       linux_ff_stop_idx(b, i);
+      continue;
+    }
+    int64_t refresh = linux_ff_refresh_at(b, i);
+    if (refresh != 0 && t >= refresh && b->fds[i] >= 0 && linux_ff_play_idx(b, i, t)) {
+      b->ff_stats.refreshes++;
     }
+    int64_t deadline = linux_ff_deadline_idx(b, i);
+    if (deadline != 0 && (next == 0 || deadline < next)) {
+      next = deadline;
+    }
+  }
+  b->ff_next_deadline_ms = next;
+}
+
+// Without the FF timer, deadlines are checked around the wait instead, and
+// the wait is cut short so it does not sleep past the next one.
+static int32_t linux_ff_bound_timeout(moon_gamepad_backend_t *b, int32_t timeout_ms) {
+  if (b->ff_next_deadline_ms == 0) {
+    return timeout_ms;
+  }
+  int64_t t = now_ms();
+  linux_ff_tick(b, t);
+  if (b->ff_next_deadline_ms == 0) {
+    return timeout_ms;
+  }
+  int64_t wait = b->ff_next_deadline_ms - t;
+  if (wait < 0) {
+    wait = 0;
+  }
+  if (timeout_ms < 0 || wait < (int64_t)timeout_ms) {
+    return (int32_t)wait;
+  }
+  return timeout_ms;
+}
+
+static void linux_ff_tick_due(moon_gamepad_backend_t *b) {
+  if (b->ff_next_deadline_ms != 0) {
+    linux_ff_tick(b, now_ms());
+  }
+}
+
+static void linux_ff_timer_rearm(moon_gamepad_backend_t *b) {
+  if (b == NULL || b->ff_timer_fd < 0) {
+    return;
+  }
+  int64_t deadline = b->ff_next_deadline_ms;
+  if (deadline == b->ff_timer_deadline_ms) {
+    return;
+  }
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its));
+  if (deadline != 0) {
+    int64_t delta = deadline - now_ms();
+    if (delta < 1) {
+      delta = 1;
+    }
+    its.it_value.tv_sec = (time_t)(delta / 1000);
+    its.it_value.tv_nsec = (long)((delta % 1000) * 1000000);
+  }
+  (void)timerfd_settime(b->ff_timer_fd, 0, &its, NULL);
+  b->ff_timer_deadline_ms = deadline;
+}
+
+static uint16_t linux_ff_scale(uint16_t v, uint16_t gain) {
+  return (uint16_t)(((uint32_t)v * (uint32_t)gain) / 0xFFFFu);
+}
+
+// The rumble-slot effect for `strong`/`weak`, with the device gain applied
+// when the driver lacks FF_GAIN.
+static void linux_ff_rumble_effect(const moon_gamepad_backend_t *b, uint32_t idx, uint16_t strong,
+                                   uint16_t weak, int32_t length_ms, struct ff_effect *e) {
+  if (!(b->ff_caps[idx] & MOON_GAMEPAD_FF_CAP_GAIN)) {
+    strong = linux_ff_scale(strong, b->ff_gain[idx]);
+    weak = linux_ff_scale(weak, b->ff_gain[idx]);
   }
+  memset(e, 0, sizeof(*e));
+  e->type = FF_RUMBLE;
+  e->id = (b->ff_id[idx] >= 0) ? b->ff_id[idx] : -1;
+  e->u.rumble.strong_magnitude = strong;
+  e->u.rumble.weak_magnitude = weak;
+  e->replay.length = (uint16_t)length_ms;
+  e->replay.delay = 0;
 }
 
+// Uploads only when the magnitudes change. An unchanged request just moves
+// the logical end; the FF timer restarts the replay before it runs out.
 static int32_t linux_ff_set_rumble_idx(moon_gamepad_backend_t *b, uint32_t idx, uint16_t strong,
                                       uint16_t weak, int32_t duration_ms) {
   if (b == NULL || idx >= b->fds_len) {
@@ -2074,37 +3098,324 @@ static int32_t linux_ff_set_rumble_idx(moon_gamepad_backend_t *b, uint32_t idx,
   if (!b->rw[idx] || !b->ff_supported[idx]) {
     return 0;
   }
-  if (duration_ms <= 0 || (strong == 0 && weak == 0)) {
-    linux_ff_stop_idx(b, idx);
+  uint16_t gain = (b->ff_caps[idx] & MOON_GAMEPAD_FF_CAP_GAIN) ? 0xFFFF : b->ff_gain[idx];
+  int silent = linux_ff_scale(strong, gain) == 0 && linux_ff_scale(weak, gain) == 0;
+  int64_t old_deadline = linux_ff_deadline_idx(b, idx);
+  if (duration_ms <= 0 || silent) {
+    if (b->ff_until_ms[idx] == 0) {
+      b->ff_stats.skipped++;
+    } else {
+      linux_ff_stop_idx(b, idx);
+      linux_ff_deadline_moved(b, idx, old_deadline);
+      linux_ff_timer_rearm(b);
+    }
     return 1;
   }
   if (duration_ms > 0xFFFF) {
     duration_ms = 0xFFFF;
   }
+  int64_t t = now_ms();
+  linux_ff_cache_t *c = &b->ff_cache[idx];
+  int same = b->ff_id[idx] >= 0 && c->strong == strong && c->weak == weak;
+  if (same && b->ff_until_ms[idx] != 0 && c->replay_end_ms > t) {
+    b->ff_stats.skipped++;
+  } else {
+    if (!same) {
+      struct ff_effect effect;
+      linux_ff_rumble_effect(b, idx, strong, weak, duration_ms, &effect);
+      if (linux_ff_upload(b, idx, &effect) < 0) {
+        return 0;
+      }
+      b->ff_stats.uploads++;
+      b->ff_id[idx] = effect.id;
+      c->strong = strong;
+      c->weak = weak;
+      c->length_ms = duration_ms;
+    }
+    if (!linux_ff_play_idx(b, idx, t)) {
+      return 0;
+    }
+  }
+  b->ff_until_ms[idx] = t + (int64_t)duration_ms;
+  linux_ff_deadline_moved(b, idx, old_deadline);
+  linux_ff_timer_rearm(b);
+  return 1;
+}
+
+static int linux_ff_offload_find(const moon_gamepad_backend_t *b, uint32_t idx,
+                                 const moon_gamepad_subscriber_t *sub, int32_t token) {
+  for (int k = 0; k < b->ff_slots[idx]; k++) {
+    const linux_ff_offload_t *o = &b->ff_offload[idx][k];
+    if (o->used && o->sub == sub && o->token == token) {
+      return k;
+    }
+  }
+  return -1;
+}
+
+// EVIOCRMFF also stops the effect if it is still playing.
+static void linux_ff_offload_erase(moon_gamepad_backend_t *b, uint32_t idx, int k) {
+  linux_ff_offload_t *o = &b->ff_offload[idx][k];
+  if (!o->used) {
+    return;
+  }
+  if (b->fds[idx] >= 0) {
+    linux_ff_erase(b, idx, (int)o->id);
+  }
+  memset(o, 0, sizeof(*o));
+}
+
+static uint16_t linux_ff_ms(int32_t ms) {
+  if (ms <= 0) {
+    return 0;
+  }
+  return (uint16_t)(ms > 0x7FFF ? 0x7FFF : ms);
+}
+
+// Picks the kernel effect type for a request: FF_RUMBLE when there is no
+// envelope, FF_RAMP for a pure attack over the whole replay, otherwise
+// FF_PERIODIC. Memoryless drivers apply a periodic magnitude to both motors.
+// Returns 0 when the device cannot express the request.
+static int linux_ff_offload_fill(uint8_t caps, const linux_ff_offload_req_t *r, struct ff_effect *e) {
+  memset(e, 0, sizeof(*e));
+  e->replay.length = linux_ff_ms(r->length_ms);
+  e->replay.delay = linux_ff_ms(r->delay_ms);
+  if (e->replay.length == 0 || r->magnitude == 0) {
+    return 0;
+  }
+  int shaped = r->attack_ms > 0 || r->fade_ms > 0;
+  if (!shaped && (caps & MOON_GAMEPAD_FF_CAP_RUMBLE)) {
+    e->type = FF_RUMBLE;
+    if (r->strong) {
+      e->u.rumble.strong_magnitude = r->magnitude;
+    } else {
+      e->u.rumble.weak_magnitude = r->magnitude;
+    }
+    return 1;
+  }
+  if (!shaped) {
+    return 0;
+  }
+  if (r->fade_ms == 0 && r->attack_ms == r->length_ms && (caps & MOON_GAMEPAD_FF_CAP_RAMP)) {
+    e->type = FF_RAMP;
+    e->u.ramp.start_level = (int16_t)(r->attack_level >> 1);
+    e->u.ramp.end_level = (int16_t)(r->magnitude >> 1);
+    return 1;
+  }
+  if (caps & MOON_GAMEPAD_FF_CAP_PERIODIC) {
+    e->type = FF_PERIODIC;
+    e->u.periodic.waveform = FF_SINE;
+    e->u.periodic.period = MOON_GAMEPAD_FF_PERIOD_MS;
+    e->u.periodic.magnitude = (int16_t)(r->magnitude >> 1);
+    e->u.periodic.envelope.attack_length = linux_ff_ms(r->attack_ms);
+    e->u.periodic.envelope.attack_level = (uint16_t)(r->attack_level >> 1);
+    e->u.periodic.envelope.fade_length = linux_ff_ms(r->fade_ms);
+    e->u.periodic.envelope.fade_level = (uint16_t)(r->fade_level >> 1);
+    return 1;
+  }
+  return 0;
+}
+
+// Fills `e` for `req`, with the device gain applied when the driver lacks
+// FF_GAIN.
+static int linux_ff_offload_effect(const moon_gamepad_backend_t *b, uint32_t idx,
+                                   const linux_ff_offload_req_t *req, struct ff_effect *e) {
+  linux_ff_offload_req_t r = *req;
+  if (!(b->ff_caps[idx] & MOON_GAMEPAD_FF_CAP_GAIN)) {
+    r.magnitude = linux_ff_scale(r.magnitude, b->ff_gain[idx]);
+    r.attack_level = linux_ff_scale(r.attack_level, b->ff_gain[idx]);
+    r.fade_level = linux_ff_scale(r.fade_level, b->ff_gain[idx]);
+  }
+  return linux_ff_offload_fill(b->ff_caps[idx], &r, e);
+}
+
+static int linux_ff_req_equal(const linux_ff_offload_req_t *a, const linux_ff_offload_req_t *b) {
+  return a->strong == b->strong && a->magnitude == b->magnitude && a->length_ms == b->length_ms &&
+         a->delay_ms == b->delay_ms && a->count == b->count && a->attack_ms == b->attack_ms &&
+         a->attack_level == b->attack_level && a->fade_ms == b->fade_ms && a->fade_level == b->fade_level;
+}
+
+// A free slot, else the least recently used one that is not playing.
+// Returns -1 when every slot is busy.
+static int linux_ff_offload_alloc(moon_gamepad_backend_t *b, uint32_t idx) {
+  int victim = -1;
+  for (int k = 0; k < b->ff_slots[idx]; k++) {
+    linux_ff_offload_t *o = &b->ff_offload[idx][k];
+    if (!o->used) {
+      return k;
+    }
+    if (!o->playing && (victim < 0 || o->last_use < b->ff_offload[idx][victim].last_use)) {
+      victim = k;
+    }
+  }
+  if (victim >= 0) {
+    linux_ff_offload_erase(b, idx, victim);
+    b->ff_stats.evictions++;
+  }
+  return victim;
+}
+
+// Starts the effect for `token` for `count` repetitions. A resident slot
+// with the same request is replayed as is; a changed one is updated in
+// place.
+static int32_t linux_ff_offload_play(moon_gamepad_backend_t *b, uint32_t idx,
+                                     const moon_gamepad_subscriber_t *sub, int32_t token,
+                                     const linux_ff_offload_req_t *req) {
+  if (b == NULL || idx >= b->fds_len || b->fds[idx] < 0) {
+    return 0;
+  }
+  if (!b->rw[idx] || !b->ff_supported[idx]) {
+    return 0;
+  }
+  int k = linux_ff_offload_find(b, idx, sub, token);
+  if (k < 0 || !linux_ff_req_equal(&b->ff_offload[idx][k].req, req)) {
+    struct ff_effect effect;
+    if (!linux_ff_offload_effect(b, idx, req, &effect)) {
+      return 0;
+    }
+    if (k < 0) {
+      k = linux_ff_offload_alloc(b, idx);
+      if (k < 0) {
+        return 0;
+      }
+      effect.id = -1;
+    } else {
+      effect.id = b->ff_offload[idx][k].id;
+    }
+    if (linux_ff_upload(b, idx, &effect) < 0) {
+      return 0;
+    }
+    linux_ff_offload_t *o = &b->ff_offload[idx][k];
+    o->used = 1;
+    o->id = effect.id;
+    o->sub = sub;
+    o->token = token;
+    o->req = *req;
+    b->ff_stats.uploads++;
+    b->ff_stats.offloads++;
+  }
+  linux_ff_offload_t *o = &b->ff_offload[idx][k];
+  if (!linux_ff_write(b, idx, (uint16_t)o->id, req->count > 0 ? req->count : 1)) {
+    linux_ff_offload_erase(b, idx, k);
+    return 0;
+  }
+  b->ff_stats.plays++;
+  o->playing = 1;
+  o->last_use = ++b->ff_use_clock;
+  return 1;
+}
+
+// Frees every slot `sub` holds, once it unsubscribes, so a later subscriber
+// at the same address does not inherit them.
+static void linux_ff_offload_forget(moon_gamepad_backend_t *b, const moon_gamepad_subscriber_t *sub) {
+  for (uint32_t idx = 0; idx < b->fds_len; idx++) {
+    for (int k = 0; k < b->ff_slots[idx]; k++) {
+      if (b->ff_offload[idx][k].used && b->ff_offload[idx][k].sub == sub) {
+        linux_ff_offload_erase(b, idx, k);
+      }
+    }
+  }
+}
+
+// Stops the effect but leaves it uploaded for the next play.
+static void linux_ff_offload_stop(moon_gamepad_backend_t *b, uint32_t idx,
+                                  const moon_gamepad_subscriber_t *sub, int32_t token) {
+  if (b == NULL || idx >= b->fds_len || b->fds[idx] < 0) {
+    return;
+  }
+  int k = linux_ff_offload_find(b, idx, sub, token);
+  if (k < 0 || !b->ff_offload[idx][k].playing) {
+    return;
+  }
+  linux_ff_offload_t *o = &b->ff_offload[idx][k];
+  (void)linux_ff_write(b, idx, (uint16_t)o->id, 0);
+  o->playing = 0;
+  b->ff_stats.stops++;
+}
+
+// Device-wide gain. Drivers with FF_GAIN scale every effect themselves;
+// otherwise the gain is applied to the magnitudes we upload, so the effects
+// already resident are uploaded again at the new gain.
+static int32_t linux_ff_set_gain_idx(moon_gamepad_backend_t *b, uint32_t idx, uint16_t gain) {
+  if (b == NULL || idx >= b->fds_len || b->fds[idx] < 0) {
+    return 0;
+  }
+  if (!b->rw[idx] || !b->ff_supported[idx]) {
+    return 0;
+  }
+  b->ff_gain[idx] = gain;
+  if (b->ff_caps[idx] & MOON_GAMEPAD_FF_CAP_GAIN) {
+    return linux_ff_write(b, idx, FF_GAIN, gain);
+  }
   struct ff_effect effect;
-  memset(&effect, 0, sizeof(effect));
-  effect.type = FF_RUMBLE;
-  effect.id = (b->ff_id[idx] >= 0) ? b->ff_id[idx] : -1;
-  effect.u.rumble.strong_magnitude = strong;
-  effect.u.rumble.weak_magnitude = weak;
-  effect.replay.length = (uint16_t)duration_ms;
-  effect.replay.delay = 0;
-  if (ioctl(b->fds[idx], EVIOCSFF, &effect) < 0) {
-    return 0;
-  }
-  b->ff_id[idx] = effect.id;
-  struct input_event ie;
-  memset(&ie, 0, sizeof(ie));
-  ie.type = EV_FF;
-  ie.code = (uint16_t)effect.id;
-  ie.value = 1;
-  if (write(b->fds[idx], &ie, sizeof(ie)) != (ssize_t)sizeof(ie)) {
-    return 0;
-  }
-  b->ff_until_ms[idx] = now_ms() + (int64_t)duration_ms;
+  if (b->ff_id[idx] >= 0) {
+    linux_ff_cache_t *c = &b->ff_cache[idx];
+    linux_ff_rumble_effect(b, idx, c->strong, c->weak, c->length_ms, &effect);
+    if (linux_ff_upload(b, idx, &effect) < 0) {
+      // Forget the magnitudes so the next request uploads again.
+      c->strong = 0;
+      c->weak = 0;
+    } else {
+      b->ff_stats.uploads++;
+    }
+  }
+  for (int k = 0; k < b->ff_slots[idx]; k++) {
+    linux_ff_offload_t *o = &b->ff_offload[idx][k];
+    if (!o->used) {
+      continue;
+    }
+    // A magnitude the gain rounds to zero cannot be uploaded; drop the slot
+    // and let the next play fall back to the software mix.
+    if (!linux_ff_offload_effect(b, idx, &o->req, &effect)) {
+      linux_ff_offload_erase(b, idx, k);
+      continue;
+    }
+    effect.id = o->id;
+    if (linux_ff_upload(b, idx, &effect) < 0) {
+      linux_ff_offload_erase(b, idx, k);
+    } else {
+      b->ff_stats.uploads++;
+    }
+  }
   return 1;
 }
 
+static void linux_copy_slot(moon_gamepad_backend_t *dst, uint32_t out, moon_gamepad_backend_t *src,
+                            uint32_t i) {
+  dst->fds[out] = src->fds[i];
+  dst->fd_ids[out] = src->fd_ids[i];
+  memcpy(dst->paths[out], src->paths[i], sizeof(dst->paths[out]));
+  dst->vendors[out] = src->vendors[i];
+  dst->products[out] = src->products[i];
+  memcpy(dst->uuids[out], src->uuids[i], sizeof(dst->uuids[out]));
+  memcpy(dst->names[out], src->names[i], sizeof(dst->names[out]));
+  memcpy(dst->axes_codes[out], src->axes_codes[i], sizeof(dst->axes_codes[out]));
+  memcpy(dst->axes_src[out], src->axes_src[i], sizeof(dst->axes_src[out]));
+  memcpy(dst->axes_value[out], src->axes_value[i], sizeof(dst->axes_value[out]));
+  dst->axes_len[out] = src->axes_len[i];
+  memcpy(dst->buttons_codes[out], src->buttons_codes[i], sizeof(dst->buttons_codes[out]));
+  memcpy(dst->buttons_src[out], src->buttons_src[i], sizeof(dst->buttons_src[out]));
+  memcpy(dst->buttons_pressed[out], src->buttons_pressed[i], sizeof(dst->buttons_pressed[out]));
+  dst->buttons_len[out] = src->buttons_len[i];
+  memcpy(dst->axis_info_codes[out], src->axis_info_codes[i], sizeof(dst->axis_info_codes[out]));
+  memcpy(dst->axis_info_min[out], src->axis_info_min[i], sizeof(dst->axis_info_min[out]));
+  memcpy(dst->axis_info_max[out], src->axis_info_max[i], sizeof(dst->axis_info_max[out]));
+  memcpy(dst->axis_info_deadzone[out], src->axis_info_deadzone[i], sizeof(dst->axis_info_deadzone[out]));
+  dst->axis_info_len[out] = src->axis_info_len[i];
+  dst->need_resync[out] = src->need_resync[i];
+  dst->ff_supported[out] = src->ff_supported[i];
+  dst->rw[out] = src->rw[i];
+  dst->ff_id[out] = src->ff_id[i];
+  dst->ff_until_ms[out] = src->ff_until_ms[i];
+  dst->ff_cache[out] = src->ff_cache[i];
+  dst->ff_caps[out] = src->ff_caps[i];
+  dst->ff_gain[out] = src->ff_gain[i];
+  memcpy(dst->ff_offload[out], src->ff_offload[i], sizeof(dst->ff_offload[out]));
+  dst->ff_slots[out] = src->ff_slots[i];
+  dst->hung_up[out] = src->hung_up[i];
+  dst->state_gen[out] = ++dst->state_clock;
+}
+
 static void linux_compact(moon_gamepad_backend_t *b) {
   if (b == NULL) {
     return;
@@ -2115,31 +3426,7 @@ static void linux_compact(moon_gamepad_backend_t *b) {
       continue;
     }
     if (out != i) {
-      b->fds[out] = b->fds[i];
-      b->fd_ids[out] = b->fd_ids[i];
-      memcpy(b->paths[out], b->paths[i], sizeof(b->paths[out]));
-      b->vendors[out] = b->vendors[i];
-      b->products[out] = b->products[i];
-      memcpy(b->uuids[out], b->uuids[i], sizeof(b->uuids[out]));
-      memcpy(b->names[out], b->names[i], sizeof(b->names[out]));
-      memcpy(b->axes_codes[out], b->axes_codes[i], sizeof(b->axes_codes[out]));
-      memcpy(b->axes_src[out], b->axes_src[i], sizeof(b->axes_src[out]));
-      memcpy(b->axes_value[out], b->axes_value[i], sizeof(b->axes_value[out]));
-      b->axes_len[out] = b->axes_len[i];
-      memcpy(b->buttons_codes[out], b->buttons_codes[i], sizeof(b->buttons_codes[out]));
-      memcpy(b->buttons_src[out], b->buttons_src[i], sizeof(b->buttons_src[out]));
-      memcpy(b->buttons_pressed[out], b->buttons_pressed[i], sizeof(b->buttons_pressed[out]));
-      b->buttons_len[out] = b->buttons_len[i];
-      memcpy(b->axis_info_codes[out], b->axis_info_codes[i], sizeof(b->axis_info_codes[out]));
-      memcpy(b->axis_info_min[out], b->axis_info_min[i], sizeof(b->axis_info_min[out]));
-      memcpy(b->axis_info_max[out], b->axis_info_max[i], sizeof(b->axis_info_max[out]));
-      memcpy(b->axis_info_deadzone[out], b->axis_info_deadzone[i], sizeof(b->axis_info_deadzone[out]));
-      b->axis_info_len[out] = b->axis_info_len[i];
-      b->need_resync[out] = b->need_resync[i];
-      b->ff_supported[out] = b->ff_supported[i];
-      b->rw[out] = b->rw[i];
-      b->ff_id[out] = b->ff_id[i];
-      b->ff_until_ms[out] = b->ff_until_ms[i];
+      linux_copy_slot(b, out, b, i);
     }
     out++;
   }
@@ -2147,32 +3434,557 @@ static void linux_compact(moon_gamepad_backend_t *b) {
   b->gamepad_count = (int32_t)b->fds_len;
 }
 
-static void linux_backend_scan(moon_gamepad_backend_t *b, int emit_connected) {
-  DIR *dir = opendir("/dev/input");
-  if (dir == NULL) {
+static void linux_epoll_add(moon_gamepad_backend_t *b, int fd) {
+  if (b->epoll_fd < 0 || fd < 0) {
     return;
   }
-  struct dirent *ent;
-  while ((ent = readdir(dir)) != NULL) {
-    if (strncmp(ent->d_name, "event", 5) != 0) {
-      continue;
+  struct epoll_event ee;
+  memset(&ee, 0, sizeof(ee));
+  ee.events = EPOLLIN;
+  ee.data.fd = fd;
+  (void)epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, fd, &ee);
+}
+
+static void linux_epoll_del(moon_gamepad_backend_t *b, int fd) {
+  if (b->epoll_fd < 0 || fd < 0) {
+    return;
+  }
+  (void)epoll_ctl(b->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+// -----------------------------------------------------------------------------
+// io_uring read path (Linux)
+// -----------------------------------------------------------------------------
+//
+// One read per device stays in flight. Completions are reaped in bulk when the
+// ring fd (itself registered in the epoll set) becomes readable, so a wakeup
+// costs one io_uring_enter instead of a read() per ready device.
+
+static void linux_handle_input_event(moon_gamepad_backend_t *b, uint32_t i, const struct input_event *ev);
+static void linux_release_idx(moon_gamepad_backend_t *b, uint32_t i);
+
+static int linux_idx_by_id(moon_gamepad_backend_t *b, uint32_t id) {
+  for (uint32_t i = 0; i < b->fds_len; i++) {
+    if (b->fds[i] >= 0 && b->fd_ids[i] == id) {
+      return (int)i;
     }
-    if (b->fds_len >= 64) {
-      break;
+  }
+  return -1;
+}
+
+static void linux_set_nonblock(int fd, int on) {
+  int fl = fcntl(fd, F_GETFL);
+  if (fl < 0) {
+    return;
+  }
+  (void)fcntl(fd, F_SETFL, on ? (fl | O_NONBLOCK) : (fl & ~O_NONBLOCK));
+}
+
+#if defined(MOON_GAMEPAD_HAVE_IO_URING)
+#define MOON_GAMEPAD_URING_ENTRIES 512u
+#define MOON_GAMEPAD_URING_BATCH 32
+#define MOON_GAMEPAD_URING_CANCEL_TAG UINT64_MAX
+
+enum { URING_SLOT_FREE = 0, URING_SLOT_ARMED = 1, URING_SLOT_CANCELING = 2 };
+
+typedef struct linux_uring_slot_t {
+  uint32_t id;
+  int fd;
+  int state;
+  struct input_event buf[MOON_GAMEPAD_URING_BATCH];
+} linux_uring_slot_t;
+
+struct linux_uring_t {
+  int fd;
+  void *sq_ring;
+  size_t sq_ring_sz;
+  void *cq_ring;
+  size_t cq_ring_sz;
+  struct io_uring_sqe *sqes;
+  size_t sqes_sz;
+  uint32_t *sq_head;
+  uint32_t *sq_tail;
+  uint32_t *sq_mask;
+  uint32_t *sq_entries;
+  uint32_t *sq_array;
+  uint32_t *cq_head;
+  uint32_t *cq_tail;
+  uint32_t *cq_mask;
+  struct io_uring_cqe *cqes;
+  uint32_t to_submit;
+  uint32_t in_flight;
+  linux_uring_slot_t slots[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+};
+
+static int linux_uring_enter(linux_uring_t *u, uint32_t min_complete) {
+  unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+  for (;;) {
+    long r = syscall(__NR_io_uring_enter, u->fd, u->to_submit, min_complete, flags, NULL, 0);
+    if (r >= 0) {
+      u->to_submit = ((uint32_t)r >= u->to_submit) ? 0 : u->to_submit - (uint32_t)r;
+      return 1;
     }
-    char path[256];
-    snprintf(path, sizeof(path), "/dev/input/%s", ent->d_name);
-    if (linux_has_path(b, path)) {
-      continue;
+    if (errno != EINTR) {
+      return 0;
     }
-    int rw = 1;
-    int fd = open(path, O_RDWR | O_NONBLOCK);
-    if (fd < 0) {
-      rw = 0;
-      fd = open(path, O_RDONLY | O_NONBLOCK);
+  }
+}
+
+static struct io_uring_sqe *linux_uring_sqe(linux_uring_t *u) {
+  uint32_t tail = *u->sq_tail;
+  if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= *u->sq_entries) {
+    (void)linux_uring_enter(u, 0);
+    if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= *u->sq_entries) {
+      return NULL;
     }
-    if (fd < 0) {
-      continue;
+  }
+  uint32_t at = tail & *u->sq_mask;
+  struct io_uring_sqe *sqe = &u->sqes[at];
+  memset(sqe, 0, sizeof(*sqe));
+  u->sq_array[at] = at;
+  return sqe;
+}
+
+static void linux_uring_commit(linux_uring_t *u) {
+  __atomic_store_n(u->sq_tail, *u->sq_tail + 1, __ATOMIC_RELEASE);
+  u->to_submit++;
+}
+
+static int linux_uring_arm(linux_uring_t *u, uint32_t s) {
+  linux_uring_slot_t *slot = &u->slots[s];
+  struct io_uring_sqe *sqe = linux_uring_sqe(u);
+  if (sqe == NULL) {
+    slot->state = URING_SLOT_FREE;
+    return 0;
+  }
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = slot->fd;
+  sqe->addr = (uint64_t)(uintptr_t)slot->buf;
+  sqe->len = (uint32_t)sizeof(slot->buf);
+  sqe->off = (uint64_t)-1;
+  sqe->user_data = s;
+  linux_uring_commit(u);
+  slot->state = URING_SLOT_ARMED;
+  u->in_flight++;
+  return 1;
+}
+
+static void linux_uring_cancel(linux_uring_t *u, uint32_t s) {
+  // The buffer stays owned by the kernel until the read's own completion.
+  u->slots[s].state = URING_SLOT_CANCELING;
+  struct io_uring_sqe *sqe = linux_uring_sqe(u);
+  if (sqe == NULL) {
+    return;
+  }
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = s;
+  sqe->user_data = MOON_GAMEPAD_URING_CANCEL_TAG;
+  linux_uring_commit(u);
+}
+
+static int linux_uring_is_fd(moon_gamepad_backend_t *b, int fd) {
+  return b->uring != NULL && b->uring->fd == fd;
+}
+
+static void linux_watch_idx(moon_gamepad_backend_t *b, uint32_t idx) {
+  if (b->reader_running) {
+    return;
+  }
+  linux_uring_t *u = b->uring;
+  if (u != NULL) {
+    for (uint32_t s = 0; s < MOON_GAMEPAD_LINUX_MAX_DEVICES; s++) {
+      if (u->slots[s].state != URING_SLOT_FREE) {
+        continue;
+      }
+      u->slots[s].id = b->fd_ids[idx];
+      u->slots[s].fd = b->fds[idx];
+      if (linux_uring_arm(u, s)) {
+        // io_uring completes reads on O_NONBLOCK files with -EAGAIN instead of
+        // waiting for data.
+        linux_set_nonblock(b->fds[idx], 0);
+        return;
+      }
+      break;
+    }
+  }
+  linux_epoll_add(b, b->fds[idx]);
+}
+
+static void linux_unwatch_idx(moon_gamepad_backend_t *b, uint32_t idx) {
+  linux_uring_t *u = b->uring;
+  if (u != NULL) {
+    for (uint32_t s = 0; s < MOON_GAMEPAD_LINUX_MAX_DEVICES; s++) {
+      if (u->slots[s].state == URING_SLOT_ARMED && u->slots[s].fd == b->fds[idx]) {
+        linux_uring_cancel(u, s);
+        (void)linux_uring_enter(u, 0);
+        return;
+      }
+    }
+  }
+  linux_epoll_del(b, b->fds[idx]);
+}
+
+static void linux_uring_reap(moon_gamepad_backend_t *b) {
+  linux_uring_t *u = b->uring;
+  if (u == NULL) {
+    return;
+  }
+  uint32_t head = *u->cq_head;
+  uint32_t tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++) {
+    struct io_uring_cqe cqe = u->cqes[head & *u->cq_mask];
+    if (cqe.user_data == MOON_GAMEPAD_URING_CANCEL_TAG || cqe.user_data >= MOON_GAMEPAD_LINUX_MAX_DEVICES) {
+      continue;
+    }
+    uint32_t s = (uint32_t)cqe.user_data;
+    linux_uring_slot_t *slot = &u->slots[s];
+    u->in_flight--;
+    int armed = slot->state == URING_SLOT_ARMED;
+    slot->state = URING_SLOT_FREE;
+    int idx = armed ? linux_idx_by_id(b, slot->id) : -1;
+    if (idx < 0 || b->fds[idx] != slot->fd) {
+      continue;
+    }
+    if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+      (void)linux_uring_arm(u, s);
+      continue;
+    }
+    if (cqe.res <= 0) {
+      linux_release_idx(b, (uint32_t)idx);
+      continue;
+    }
+    uint32_t n = (uint32_t)cqe.res / (uint32_t)sizeof(struct input_event);
+    for (uint32_t k = 0; k < n; k++) {
+      linux_handle_input_event(b, (uint32_t)idx, &slot->buf[k]);
+    }
+    (void)linux_uring_arm(u, s);
+  }
+  __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+  if (u->to_submit > 0) {
+    (void)linux_uring_enter(u, 0);
+  }
+}
+
+static void linux_uring_unmap(linux_uring_t *u) {
+  if (u->sqes != NULL && u->sqes != MAP_FAILED) {
+    munmap(u->sqes, u->sqes_sz);
+  }
+  if (u->cq_ring != NULL && u->cq_ring != MAP_FAILED && u->cq_ring != u->sq_ring) {
+    munmap(u->cq_ring, u->cq_ring_sz);
+  }
+  if (u->sq_ring != NULL && u->sq_ring != MAP_FAILED) {
+    munmap(u->sq_ring, u->sq_ring_sz);
+  }
+  if (u->fd >= 0) {
+    close(u->fd);
+  }
+  free(u);
+}
+
+static int linux_uring_open(moon_gamepad_backend_t *b) {
+  if (b->uring != NULL) {
+    return 1;
+  }
+  if (b->epoll_fd < 0 || b->reader_running) {
+    return 0;
+  }
+  linux_uring_t *u = (linux_uring_t *)calloc(1, sizeof(linux_uring_t));
+  if (u == NULL) {
+    return 0;
+  }
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  u->fd = (int)syscall(__NR_io_uring_setup, MOON_GAMEPAD_URING_ENTRIES, &p);
+  if (u->fd < 0) {
+    free(u);
+    return 0;
+  }
+  u->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+  u->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single && u->cq_ring_sz > u->sq_ring_sz) {
+    u->sq_ring_sz = u->cq_ring_sz;
+  }
+  u->sq_ring = mmap(NULL, u->sq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                    IORING_OFF_SQ_RING);
+  u->cq_ring = single ? u->sq_ring
+                      : mmap(NULL, u->cq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                             IORING_OFF_CQ_RING);
+  u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = (struct io_uring_sqe *)mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                        u->fd, IORING_OFF_SQES);
+  if (u->sq_ring == MAP_FAILED || u->cq_ring == MAP_FAILED || u->sqes == MAP_FAILED) {
+    linux_uring_unmap(u);
+    return 0;
+  }
+  uint8_t *sq = (uint8_t *)u->sq_ring;
+  uint8_t *cq = (uint8_t *)u->cq_ring;
+  u->sq_head = (uint32_t *)(sq + p.sq_off.head);
+  u->sq_tail = (uint32_t *)(sq + p.sq_off.tail);
+  u->sq_mask = (uint32_t *)(sq + p.sq_off.ring_mask);
+  u->sq_entries = (uint32_t *)(sq + p.sq_off.ring_entries);
+  u->sq_array = (uint32_t *)(sq + p.sq_off.array);
+  u->cq_head = (uint32_t *)(cq + p.cq_off.head);
+  u->cq_tail = (uint32_t *)(cq + p.cq_off.tail);
+  u->cq_mask = (uint32_t *)(cq + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  b->uring = u;
+  linux_epoll_add(b, u->fd);
+  for (uint32_t i = 0; i < b->fds_len; i++) {
+    if (b->fds[i] >= 0) {
+      linux_epoll_del(b, b->fds[i]);
+      linux_watch_idx(b, i);
+    }
+  }
+  (void)linux_uring_enter(u, 0);
+  return 1;
+}
+
+// Cancels every in-flight read and waits for the kernel to release the
+// buffers, then hands the devices back to epoll.
+static void linux_uring_close(moon_gamepad_backend_t *b) {
+  linux_uring_t *u = b->uring;
+  if (u == NULL) {
+    return;
+  }
+  for (uint32_t s = 0; s < MOON_GAMEPAD_LINUX_MAX_DEVICES; s++) {
+    if (u->slots[s].state == URING_SLOT_ARMED) {
+      linux_uring_cancel(u, s);
+    }
+  }
+  while (u->in_flight > 0) {
+    if (!linux_uring_enter(u, 1)) {
+      break;
+    }
+    uint32_t head = *u->cq_head;
+    uint32_t tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      uint64_t tag = u->cqes[head & *u->cq_mask].user_data;
+      if (tag < MOON_GAMEPAD_LINUX_MAX_DEVICES) {
+        u->slots[tag].state = URING_SLOT_FREE;
+        u->in_flight--;
+      }
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+  }
+  linux_epoll_del(b, u->fd);
+  b->uring = NULL;
+  linux_uring_unmap(u);
+  for (uint32_t i = 0; i < b->fds_len; i++) {
+    if (b->fds[i] >= 0) {
+      linux_set_nonblock(b->fds[i], 1);
+      linux_epoll_add(b, b->fds[i]);
+    }
+  }
+}
+#else
+static int linux_uring_is_fd(moon_gamepad_backend_t *b, int fd) {
+  (void)b;
+  (void)fd;
+  return 0;
+}
+
+static void linux_watch_idx(moon_gamepad_backend_t *b, uint32_t idx) {
+  if (b->reader_running) {
+    return;
+  }
+  linux_epoll_add(b, b->fds[idx]);
+}
+
+static void linux_unwatch_idx(moon_gamepad_backend_t *b, uint32_t idx) {
+  linux_epoll_del(b, b->fds[idx]);
+}
+
+static void linux_uring_reap(moon_gamepad_backend_t *b) {
+  (void)b;
+}
+
+static int linux_uring_open(moon_gamepad_backend_t *b) {
+  (void)b;
+  return 0;
+}
+
+static void linux_uring_close(moon_gamepad_backend_t *b) {
+  (void)b;
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// Device filter (Linux)
+// -----------------------------------------------------------------------------
+
+static void linux_filter_copy_str(char *dst, size_t cap, const char *src, size_t n) {
+  if (n >= cap) {
+    n = cap - 1;
+  }
+  memcpy(dst, src, n);
+  dst[n] = '\0';
+}
+
+// Parses newline-separated `kind=value` entries: path=<glob>, uuid=<32 hex>,
+// id=<vendor hex>[:<product hex>], seat=<name>, tag=<name>. Unknown kinds and
+// entries beyond MOON_GAMEPAD_FILTER_MAX are ignored. The sysfs and udev roots
+// come from the MOON_GAMEPAD_SYSFS_INPUT_DIR and MOON_GAMEPAD_UDEV_DATA_DIR
+// environment variables, else from the macros of the same name.
+static void linux_filter_parse(linux_device_filter_t *f, const char *spec) {
+  memset(f, 0, sizeof(*f));
+  const char *sysfs = getenv("MOON_GAMEPAD_SYSFS_INPUT_DIR");
+  const char *udev = getenv("MOON_GAMEPAD_UDEV_DATA_DIR");
+  snprintf(f->sysfs_dir, sizeof(f->sysfs_dir), "%s",
+           (sysfs != NULL && *sysfs != '\0') ? sysfs : MOON_GAMEPAD_SYSFS_INPUT_DIR);
+  snprintf(f->udev_dir, sizeof(f->udev_dir), "%s",
+           (udev != NULL && *udev != '\0') ? udev : MOON_GAMEPAD_UDEV_DATA_DIR);
+  const char *line = spec;
+  while (line != NULL && *line != '\0') {
+    const char *end = strchr(line, '\n');
+    size_t len = end != NULL ? (size_t)(end - line) : strlen(line);
+    const char *eq = memchr(line, '=', len);
+    if (eq != NULL) {
+      size_t klen = (size_t)(eq - line);
+      const char *v = eq + 1;
+      size_t vlen = len - klen - 1;
+      char val[128];
+      linux_filter_copy_str(val, sizeof(val), v, vlen);
+      if (klen == 4 && memcmp(line, "path", 4) == 0 && f->paths_len < MOON_GAMEPAD_FILTER_MAX) {
+        linux_filter_copy_str(f->paths[f->paths_len++], sizeof(f->paths[0]), v, vlen);
+      } else if (klen == 4 && memcmp(line, "uuid", 4) == 0 && f->uuids_len < MOON_GAMEPAD_FILTER_MAX) {
+        linux_filter_copy_str(f->uuids[f->uuids_len++], sizeof(f->uuids[0]), v, vlen);
+      } else if (klen == 2 && memcmp(line, "id", 2) == 0 && f->ids_len < MOON_GAMEPAD_FILTER_MAX) {
+        char *rest = NULL;
+        f->vendors[f->ids_len] = (int32_t)strtol(val, &rest, 16);
+        f->products[f->ids_len] = (rest != NULL && *rest == ':') ? (int32_t)strtol(rest + 1, NULL, 16) : -1;
+        f->ids_len++;
+      } else if (klen == 4 && memcmp(line, "seat", 4) == 0 && f->seats_len < MOON_GAMEPAD_FILTER_MAX) {
+        linux_filter_copy_str(f->seats[f->seats_len++], sizeof(f->seats[0]), v, vlen);
+      } else if (klen == 3 && memcmp(line, "tag", 3) == 0 && f->tags_len < MOON_GAMEPAD_FILTER_MAX) {
+        linux_filter_copy_str(f->tags[f->tags_len++], sizeof(f->tags[0]), v, vlen);
+      }
+    }
+    line = end != NULL ? end + 1 : NULL;
+  }
+}
+
+static int32_t linux_sysfs_read_hex(const linux_device_filter_t *f, const char *event_name, const char *attr) {
+  char path[512];
+  char buf[32];
+  snprintf(path, sizeof(path), "%s/%s/device/id/%s", f->sysfs_dir, event_name, attr);
+  if (!linux_read_first_line(path, buf, sizeof(buf))) {
+    return -1;
+  }
+  return (int32_t)strtol(buf, NULL, 16);
+}
+
+// Reads ID_SEAT (default seat0) and the udev tags recorded for the node.
+static int linux_udev_seat_has_tag(const char *event_name, const linux_device_filter_t *f) {
+  char path[512];
+  char dev[32];
+  snprintf(path, sizeof(path), "%s/%s/dev", f->sysfs_dir, event_name);
+  if (!linux_read_first_line(path, dev, sizeof(dev))) {
+    return 0;
+  }
+  snprintf(path, sizeof(path), "%s/c%s", f->udev_dir, dev);
+  char seat[64] = "seat0";
+  int tag_ok = f->tags_len == 0;
+  FILE *fp = fopen(path, "r");
+  if (fp != NULL) {
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+      line[strcspn(line, "\r\n")] = '\0';
+      if (strncmp(line, "E:ID_SEAT=", 10) == 0) {
+        linux_filter_copy_str(seat, sizeof(seat), line + 10, strlen(line + 10));
+      } else if (line[0] == 'G' && line[1] == ':') {
+        for (uint32_t k = 0; k < f->tags_len; k++) {
+          if (strcmp(line + 2, f->tags[k]) == 0) {
+            tag_ok = 1;
+          }
+        }
+      }
+    }
+    fclose(fp);
+  }
+  int seat_ok = f->seats_len == 0;
+  for (uint32_t k = 0; k < f->seats_len; k++) {
+    if (strcmp(seat, f->seats[k]) == 0) {
+      seat_ok = 1;
+    }
+  }
+  return seat_ok && tag_ok;
+}
+
+// Decides from the path and sysfs alone, so rejected nodes are never opened.
+static int linux_filter_allows(const linux_device_filter_t *f, const char *event_name, const char *path) {
+  if (f->paths_len != 0) {
+    int ok = 0;
+    for (uint32_t k = 0; k < f->paths_len && !ok; k++) {
+      ok = fnmatch(f->paths[k], path, FNM_PATHNAME) == 0;
+    }
+    if (!ok) {
+      return 0;
+    }
+  }
+  if (f->uuids_len != 0 || f->ids_len != 0) {
+    int32_t bus = linux_sysfs_read_hex(f, event_name, "bustype");
+    int32_t vendor = linux_sysfs_read_hex(f, event_name, "vendor");
+    int32_t product = linux_sysfs_read_hex(f, event_name, "product");
+    int32_t version = linux_sysfs_read_hex(f, event_name, "version");
+    if (f->ids_len != 0) {
+      int ok = 0;
+      for (uint32_t k = 0; k < f->ids_len && !ok; k++) {
+        ok = vendor == f->vendors[k] && (f->products[k] < 0 || product == f->products[k]);
+      }
+      if (!ok) {
+        return 0;
+      }
+    }
+    if (f->uuids_len != 0) {
+      if (bus < 0 || vendor < 0 || product < 0 || version < 0) {
+        return 0;
+      }
+      char uuid[33];
+      uuid_simple_from_ids((uint16_t)bus, (uint16_t)vendor, (uint16_t)product, (uint16_t)version, uuid);
+      int ok = 0;
+      for (uint32_t k = 0; k < f->uuids_len && !ok; k++) {
+        ok = strcasecmp(uuid, f->uuids[k]) == 0;
+      }
+      if (!ok) {
+        return 0;
+      }
+    }
+  }
+  if (f->seats_len != 0 || f->tags_len != 0) {
+    return linux_udev_seat_has_tag(event_name, f);
+  }
+  return 1;
+}
+
+static void linux_backend_scan(moon_gamepad_backend_t *b, int emit_connected) {
+  DIR *dir = opendir("/dev/input");
+  if (dir == NULL) {
+    return;
+  }
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL) {
+    if (strncmp(ent->d_name, "event", 5) != 0) {
+      continue;
+    }
+    if (b->fds_len >= MOON_GAMEPAD_LINUX_MAX_DEVICES ||
+        __atomic_load_n(&b->probe_cancel, __ATOMIC_RELAXED)) {
+      break;
+    }
+    char path[256];
+    snprintf(path, sizeof(path), "/dev/input/%s", ent->d_name);
+    if (linux_has_path(b, path) || !linux_filter_allows(&b->filter, ent->d_name, path)) {
+      continue;
+    }
+    int rw = 1;
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    if (fd < 0) {
+      rw = 0;
+      fd = open(path, O_RDONLY | O_NONBLOCK);
+    }
+    if (fd < 0) {
+      continue;
     }
     if (!linux_is_gamepad_fd(fd)) {
       close(fd);
@@ -2226,6 +4038,12 @@ static void linux_backend_scan(moon_gamepad_backend_t *b, int emit_connected) {
     strncpy(b->uuids[b->fds_len], uuid, sizeof(b->uuids[b->fds_len]) - 1);
     b->ff_id[b->fds_len] = -1;
     b->ff_until_ms[b->fds_len] = 0;
+    memset(&b->ff_cache[b->fds_len], 0, sizeof(b->ff_cache[b->fds_len]));
+    b->ff_caps[b->fds_len] = 0;
+    b->ff_gain[b->fds_len] = 0xFFFF;
+    memset(b->ff_offload[b->fds_len], 0, sizeof(b->ff_offload[b->fds_len]));
+    b->ff_slots[b->fds_len] = 0;
+    b->state_gen[b->fds_len] = ++b->state_clock;
 
     char name[256];
     memset(name, 0, sizeof(name));
@@ -2240,22 +4058,39 @@ static void linux_backend_scan(moon_gamepad_backend_t *b, int emit_connected) {
     if (ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ffbit)), ffbit) >= 0) {
       if (test_bit(FF_RUMBLE, ffbit)) {
         b->ff_supported[b->fds_len] = 1;
+        b->ff_caps[b->fds_len] |= MOON_GAMEPAD_FF_CAP_RUMBLE;
+      }
+      if (test_bit(FF_PERIODIC, ffbit)) {
+        b->ff_caps[b->fds_len] |= MOON_GAMEPAD_FF_CAP_PERIODIC;
+      }
+      if (test_bit(FF_RAMP, ffbit)) {
+        b->ff_caps[b->fds_len] |= MOON_GAMEPAD_FF_CAP_RAMP;
+      }
+      if (test_bit(FF_GAIN, ffbit)) {
+        b->ff_caps[b->fds_len] |= MOON_GAMEPAD_FF_CAP_GAIN;
+      }
+      // One kernel slot stays with the software rumble mix.
+      int slots = 0;
+      if (ioctl(fd, EVIOCGEFFECTS, &slots) >= 0 && slots > 1) {
+        b->ff_slots[b->fds_len] =
+            (uint8_t)(slots - 1 > MOON_GAMEPAD_FF_SLOT_MAX ? MOON_GAMEPAD_FF_SLOT_MAX : slots - 1);
       }
     }
     if (!rw) {
       b->ff_supported[b->fds_len] = 0;
     }
+    linux_watch_idx(b, b->fds_len);
     b->fds_len++;
     b->gamepad_count = (int32_t)b->fds_len;
     if (emit_connected) {
       moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_CONNECTED, id, 0, 0, 0.0, now_ms()};
-      queue_push(&b->q, ev);
+      backend_emit(b, ev);
     }
   }
   closedir(dir);
 }
 
-static void linux_backend_init(moon_gamepad_backend_t *b) {
+static void linux_reset_tables(moon_gamepad_backend_t *b) {
   b->fds_len = 0;
   b->next_id = 0;
   b->disconnected_head = NULL;
@@ -2282,21 +4117,148 @@ static void linux_backend_init(moon_gamepad_backend_t *b) {
   memset(b->need_resync, 0, sizeof(b->need_resync));
   memset(b->ff_supported, 0, sizeof(b->ff_supported));
   memset(b->rw, 0, sizeof(b->rw));
-  for (int i = 0; i < 64; i++) {
+  memset(b->ff_cache, 0, sizeof(b->ff_cache));
+  memset(b->ff_caps, 0, sizeof(b->ff_caps));
+  memset(b->ff_offload, 0, sizeof(b->ff_offload));
+  memset(b->ff_slots, 0, sizeof(b->ff_slots));
+  b->ff_use_clock = 0;
+  memset(&b->ff_stats, 0, sizeof(b->ff_stats));
+  for (int i = 0; i < MOON_GAMEPAD_LINUX_MAX_DEVICES; i++) {
     b->ff_id[i] = -1;
     b->ff_until_ms[i] = 0;
+    b->ff_gain[i] = 0xFFFF;
   }
-  for (int i = 0; i < 64; i++) {
+  for (int i = 0; i < MOON_GAMEPAD_LINUX_MAX_DEVICES; i++) {
     b->vendors[i] = -1;
     b->products[i] = -1;
   }
-  linux_backend_scan(b, 0);
+  b->ff_timer_deadline_ms = 0;
+  b->ff_next_deadline_ms = 0;
+  b->uring = NULL;
+  b->probe = NULL;
+  b->probe_fd = -1;
+}
+
+// -----------------------------------------------------------------------------
+// Background device probing (Linux)
+// -----------------------------------------------------------------------------
+//
+// Opening and probing every node (EVIOCGABS per axis, slow Bluetooth pads)
+// can take a while, so an async backend scans on a helper thread into a
+// private table. The owning thread adopts the finished table on its next
+// poll and announces each device with an ordinary Connected event.
+
+static moon_gamepad_backend_t *backend_create(void);
+static void backend_destroy(moon_gamepad_backend_t *b);
+
+static void *linux_probe_main(void *arg) {
+  moon_gamepad_backend_t *b = (moon_gamepad_backend_t *)arg;
+  linux_backend_scan(b->probe, 0);
+  uint64_t one = 1;
+  (void)!write(b->probe_fd, &one, sizeof(one));
+  return NULL;
+}
+
+static int linux_probe_start(moon_gamepad_backend_t *b) {
+  if (b->epoll_fd < 0) {
+    return 0;
+  }
+  moon_gamepad_backend_t *p = backend_create();
+  if (p == NULL) {
+    return 0;
+  }
+  linux_reset_tables(p);
+  p->filter = b->filter;
+  p->epoll_fd = -1;
+  p->hotplug_fd = -1;
+  p->ff_timer_fd = -1;
+  b->probe_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (b->probe_fd < 0) {
+    backend_destroy(p);
+    return 0;
+  }
+  b->probe = p;
+  if (pthread_create(&b->probe_thread, NULL, linux_probe_main, b) != 0) {
+    b->probe = NULL;
+    close(b->probe_fd);
+    b->probe_fd = -1;
+    backend_destroy(p);
+    return 0;
+  }
+  linux_epoll_add(b, b->probe_fd);
+  return 1;
+}
+
+// Joins the probe thread and, when `adopt` is set, moves its devices into the
+// live table. Hotplug events seen meanwhile are covered by a rescan.
+static void linux_probe_finish(moon_gamepad_backend_t *b, int adopt) {
+  moon_gamepad_backend_t *p = b->probe;
+  if (p == NULL) {
+    return;
+  }
+  if (!adopt) {
+    __atomic_store_n(&p->probe_cancel, 1, __ATOMIC_RELAXED);
+  }
+  pthread_join(b->probe_thread, NULL);
+  linux_epoll_del(b, b->probe_fd);
+  close(b->probe_fd);
+  b->probe_fd = -1;
+  b->probe = NULL;
+  for (uint32_t i = 0; adopt && i < p->fds_len; i++) {
+    if (p->fds[i] < 0 || b->fds_len >= MOON_GAMEPAD_LINUX_MAX_DEVICES || linux_has_path(b, p->paths[i])) {
+      continue;
+    }
+    uint32_t idx = b->fds_len;
+    linux_copy_slot(b, idx, p, i);
+    p->fds[i] = -1;
+    uint32_t id = 0;
+    if (!linux_disconnected_cache_take_id(b, b->uuids[idx], &id)) {
+      id = b->next_id++;
+    } else if (id >= b->next_id) {
+      b->next_id = id + 1;
+    }
+    b->fd_ids[idx] = id;
+    b->hung_up[idx] = 0;
+    linux_watch_idx(b, idx);
+    b->fds_len++;
+    b->gamepad_count = (int32_t)b->fds_len;
+    moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_CONNECTED, id, 0, 0, 0.0, now_ms()};
+    backend_emit(b, ev);
+  }
+  backend_destroy(p);
+  if (adopt) {
+    linux_backend_scan(b, 1);
+  }
+}
+
+static void linux_backend_init(moon_gamepad_backend_t *b) {
+  linux_reset_tables(b);
+  b->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  b->ff_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  b->hotplug_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (b->hotplug_fd >= 0 &&
+      inotify_add_watch(b->hotplug_fd, "/dev/input", IN_CREATE | IN_ATTRIB | IN_MOVED_TO) < 0) {
+    close(b->hotplug_fd);
+    b->hotplug_fd = -1;
+  }
+  linux_epoll_add(b, b->hotplug_fd);
+  linux_epoll_add(b, b->ff_timer_fd);
+  if (!b->async_probe || !linux_probe_start(b)) {
+    linux_backend_scan(b, 0);
+  }
 }
 
+static void linux_reader_stop(moon_gamepad_backend_t *b);
+static void linux_ff_sched_stop(moon_gamepad_backend_t *b);
+
 static void linux_backend_shutdown(moon_gamepad_backend_t *b) {
   if (b == NULL) {
     return;
   }
+  linux_probe_finish(b, 0);
+  linux_ff_sched_stop(b);
+  linux_reader_stop(b);
+  linux_uring_close(b);
   for (uint32_t i = 0; i < b->fds_len; i++) {
     if (b->fds[i] >= 0) {
       linux_ff_remove_idx(b, i);
@@ -2304,8 +4266,29 @@ static void linux_backend_shutdown(moon_gamepad_backend_t *b) {
       b->fds[i] = -1;
     }
   }
+  if (b->epoll_fd >= 0) {
+    close(b->epoll_fd);
+    b->epoll_fd = -1;
+  }
+  if (b->hotplug_fd >= 0) {
+    close(b->hotplug_fd);
+    b->hotplug_fd = -1;
+  }
+  if (b->ff_timer_fd >= 0) {
+    close(b->ff_timer_fd);
+    b->ff_timer_fd = -1;
+  }
+  if (b->fake != NULL) {
+    for (uint32_t i = 0; i < b->fake->len; i++) {
+      close(b->fake->wr[i]);
+    }
+    free(b->fake);
+    b->fake = NULL;
+  }
+  b->ff_timer_deadline_ms = 0;
+  b->ff_next_deadline_ms = 0;
   memset(b->paths, 0, sizeof(b->paths));
-  for (int i = 0; i < 64; i++) {
+  for (int i = 0; i < MOON_GAMEPAD_LINUX_MAX_DEVICES; i++) {
     b->vendors[i] = -1;
     b->products[i] = -1;
     memset(b->uuids[i], 0, sizeof(b->uuids[i]));
@@ -2328,6 +4311,11 @@ static void linux_backend_shutdown(moon_gamepad_backend_t *b) {
     b->rw[i] = 0;
     b->ff_id[i] = -1;
     b->ff_until_ms[i] = 0;
+    memset(&b->ff_cache[i], 0, sizeof(b->ff_cache[i]));
+    b->ff_caps[i] = 0;
+    b->ff_gain[i] = 0xFFFF;
+    memset(b->ff_offload[i], 0, sizeof(b->ff_offload[i]));
+    b->ff_slots[i] = 0;
   }
   b->fds_len = 0;
   linux_disconnected_cache_clear(b);
@@ -2339,153 +4327,875 @@ static void linux_backend_poll(moon_gamepad_backend_t *b) {
   linux_backend_poll_timeout(b, 0);
 }
 
-static void linux_backend_poll_timeout(moon_gamepad_backend_t *b, int32_t timeout_ms) {
-  if (b == NULL) {
-    return;
-  }
-  linux_ff_tick(b);
-  // Best-effort rescan for hotplug.
-  linux_backend_scan(b, 1);
-  linux_compact(b);
-  if (b->fds_len == 0) {
+static void linux_release_idx(moon_gamepad_backend_t *b, uint32_t i) {
+  uint32_t id = b->fd_ids[i];
+  moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_DISCONNECTED, id, 0, 0, 0.0, now_ms()};
+  backend_emit(b, ev);
+  linux_disconnected_cache_set(b, id, b->uuids[i]);
+  linux_ff_remove_idx(b, i);
+  linux_unwatch_idx(b, i);
+  close(b->fds[i]);
+  b->fds[i] = -1;
+  memset(b->paths[i], 0, sizeof(b->paths[i]));
+  b->vendors[i] = -1;
+  b->products[i] = -1;
+  memset(b->uuids[i], 0, sizeof(b->uuids[i]));
+  memset(b->names[i], 0, sizeof(b->names[i]));
+  memset(b->axes_codes[i], 0, sizeof(b->axes_codes[i]));
+  memset(b->axes_src[i], 0, sizeof(b->axes_src[i]));
+  memset(b->axes_value[i], 0, sizeof(b->axes_value[i]));
+  b->axes_len[i] = 0;
+  memset(b->buttons_codes[i], 0, sizeof(b->buttons_codes[i]));
+  memset(b->buttons_src[i], 0, sizeof(b->buttons_src[i]));
+  memset(b->buttons_pressed[i], 0, sizeof(b->buttons_pressed[i]));
+  b->buttons_len[i] = 0;
+  memset(b->axis_info_codes[i], 0, sizeof(b->axis_info_codes[i]));
+  memset(b->axis_info_min[i], 0, sizeof(b->axis_info_min[i]));
+  memset(b->axis_info_max[i], 0, sizeof(b->axis_info_max[i]));
+  memset(b->axis_info_deadzone[i], 0, sizeof(b->axis_info_deadzone[i]));
+  b->axis_info_len[i] = 0;
+  b->need_resync[i] = 0;
+  b->ff_supported[i] = 0;
+  b->rw[i] = 0;
+  b->ff_id[i] = -1;
+  b->ff_until_ms[i] = 0;
+  memset(&b->ff_cache[i], 0, sizeof(b->ff_cache[i]));
+  b->ff_caps[i] = 0;
+  b->ff_gain[i] = 0xFFFF;
+  memset(b->ff_offload[i], 0, sizeof(b->ff_offload[i]));
+  b->ff_slots[i] = 0;
+  b->hung_up[i] = 0;
+}
+
+static void linux_record_latency(moon_gamepad_backend_t *b, const struct input_event *ev) {
+  int64_t sent_us = (int64_t)ev->time.tv_sec * 1000000LL + (int64_t)ev->time.tv_usec;
+  if (sent_us <= 0) {
     return;
   }
-  struct pollfd pfds[64];
-  for (uint32_t i = 0; i < b->fds_len; i++) {
-    pfds[i].fd = b->fds[i];
-    pfds[i].events = POLLIN | POLLERR | POLLHUP | POLLNVAL;
-    pfds[i].revents = 0;
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  int64_t lat = (int64_t)ts.tv_sec * 1000000LL + (int64_t)(ts.tv_nsec / 1000) - sent_us;
+  uint32_t k = 0;
+  while (lat > 0 && k + 1 < MOON_GAMEPAD_LATENCY_BUCKETS) {
+    lat >>= 1;
+    k++;
   }
-  int n = poll(pfds, (nfds_t)b->fds_len, timeout_ms);
-  linux_ff_tick(b);
-  if (n <= 0) {
+  __atomic_fetch_add(&b->latency_hist[k], 1u, __ATOMIC_RELAXED);
+}
+
+static void linux_handle_input_event(moon_gamepad_backend_t *b, uint32_t i, const struct input_event *ev) {
+  uint32_t id = b->fd_ids[i];
+  int64_t t = linux_input_event_time_ms(ev);
+  if (ev->type == EV_SYN && ev->code == SYN_DROPPED) {
+    b->need_resync[i] = 1;
     return;
   }
-  for (uint32_t i = 0; i < b->fds_len; i++) {
-    if ((pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0) {
-      uint32_t id = b->fd_ids[i];
-      moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_DISCONNECTED, id, 0, 0, 0.0, now_ms()};
-      queue_push(&b->q, ev);
-      linux_disconnected_cache_set(b, id, b->uuids[i]);
-      linux_ff_remove_idx(b, i);
-      close(b->fds[i]);
-      b->fds[i] = -1;
-      memset(b->paths[i], 0, sizeof(b->paths[i]));
-      b->vendors[i] = -1;
-      b->products[i] = -1;
-      memset(b->uuids[i], 0, sizeof(b->uuids[i]));
-      memset(b->names[i], 0, sizeof(b->names[i]));
-      memset(b->axes_codes[i], 0, sizeof(b->axes_codes[i]));
-      memset(b->axes_src[i], 0, sizeof(b->axes_src[i]));
-      memset(b->axes_value[i], 0, sizeof(b->axes_value[i]));
-      b->axes_len[i] = 0;
-      memset(b->buttons_codes[i], 0, sizeof(b->buttons_codes[i]));
-      memset(b->buttons_src[i], 0, sizeof(b->buttons_src[i]));
-      memset(b->buttons_pressed[i], 0, sizeof(b->buttons_pressed[i]));
-      b->buttons_len[i] = 0;
-      memset(b->axis_info_codes[i], 0, sizeof(b->axis_info_codes[i]));
-      memset(b->axis_info_min[i], 0, sizeof(b->axis_info_min[i]));
-      memset(b->axis_info_max[i], 0, sizeof(b->axis_info_max[i]));
-      memset(b->axis_info_deadzone[i], 0, sizeof(b->axis_info_deadzone[i]));
-      b->axis_info_len[i] = 0;
+  if (b->need_resync[i]) {
+    if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+      linux_resync_device_state(b, i, 1);
       b->need_resync[i] = 0;
-      b->ff_supported[i] = 0;
-      b->rw[i] = 0;
-      b->ff_id[i] = -1;
-      b->ff_until_ms[i] = 0;
-      continue;
     }
-    if ((pfds[i].revents & POLLIN) == 0) {
-      continue;
+    return;
+  }
+  if (ev->type == EV_KEY || ev->type == EV_ABS) {
+    linux_record_latency(b, ev);
+  }
+  if (ev->type == EV_KEY) {
+    uint32_t code = map_linux_btn((uint16_t)ev->code);
+    if (code == UINT32_MAX) {
+      return;
     }
-    struct input_event ev;
-    ssize_t r;
-    while ((r = read(pfds[i].fd, &ev, sizeof(ev))) == (ssize_t)sizeof(ev)) {
-      uint32_t id = b->fd_ids[i];
-      int64_t t = linux_input_event_time_ms(&ev);
-      if (ev.type == EV_SYN && ev.code == SYN_DROPPED) {
-        b->need_resync[i] = 1;
-        continue;
-      }
-      if (b->need_resync[i]) {
-        if (ev.type == EV_SYN && ev.code == SYN_REPORT) {
-          linux_resync_device_state(b, i, 1);
-          b->need_resync[i] = 0;
-        }
-        continue;
-      }
-      if (ev.type == EV_KEY) {
-        uint32_t code = map_linux_btn((uint16_t)ev.code);
-        if (code == UINT32_MAX) {
-          continue;
-        }
-        if (ev.value != 0 && ev.value != 1) {
-          continue;
-        }
-        int btn_idx = linux_button_slot_by_code(b, i, code);
-        if (btn_idx >= 0) {
-          b->buttons_pressed[i][(uint8_t)btn_idx] = (uint8_t)((ev.value == 1) ? 1 : 0);
-        }
-        moon_gamepad_event_t out;
-        out.tag = (ev.value == 1) ? MOON_GAMEPAD_EV_BUTTON_PRESSED : MOON_GAMEPAD_EV_BUTTON_RELEASED;
-        out.id = id;
-        out.code = code;
-        out.pad = 0;
-        out.value = (ev.value == 1) ? 1.0 : 0.0;
-        out.time_ms = t;
-        queue_push(&b->q, out);
-      } else if (ev.type == EV_ABS) {
-        uint32_t code = map_linux_abs((uint16_t)ev.code);
-        if (code == UINT32_MAX) {
-          continue;
-        }
-        int axis_idx = linux_axis_slot_by_code(b, i, code);
-        if (axis_idx >= 0) {
-          b->axes_value[i][(uint8_t)axis_idx] = (int32_t)ev.value;
-        }
-        moon_gamepad_event_t out = {
-            MOON_GAMEPAD_EV_AXIS_CHANGED, id, code, 0, (double)((int32_t)ev.value), t};
-        queue_push(&b->q, out);
-      }
+    if (ev->value != 0 && ev->value != 1) {
+      return;
     }
-    if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
-      uint32_t id = b->fd_ids[i];
-      moon_gamepad_event_t dv = {MOON_GAMEPAD_EV_DISCONNECTED, id, 0, 0, 0.0, now_ms()};
-      queue_push(&b->q, dv);
-      linux_disconnected_cache_set(b, id, b->uuids[i]);
-      linux_ff_remove_idx(b, i);
-      close(b->fds[i]);
-      b->fds[i] = -1;
-      memset(b->paths[i], 0, sizeof(b->paths[i]));
-      b->vendors[i] = -1;
-      b->products[i] = -1;
-      memset(b->uuids[i], 0, sizeof(b->uuids[i]));
-      memset(b->names[i], 0, sizeof(b->names[i]));
-      memset(b->axes_codes[i], 0, sizeof(b->axes_codes[i]));
-      memset(b->axes_src[i], 0, sizeof(b->axes_src[i]));
-      memset(b->axes_value[i], 0, sizeof(b->axes_value[i]));
-      b->axes_len[i] = 0;
-      memset(b->buttons_codes[i], 0, sizeof(b->buttons_codes[i]));
-      memset(b->buttons_src[i], 0, sizeof(b->buttons_src[i]));
-      memset(b->buttons_pressed[i], 0, sizeof(b->buttons_pressed[i]));
-      b->buttons_len[i] = 0;
-      memset(b->axis_info_codes[i], 0, sizeof(b->axis_info_codes[i]));
-      memset(b->axis_info_min[i], 0, sizeof(b->axis_info_min[i]));
-      memset(b->axis_info_max[i], 0, sizeof(b->axis_info_max[i]));
-      memset(b->axis_info_deadzone[i], 0, sizeof(b->axis_info_deadzone[i]));
-      b->axis_info_len[i] = 0;
-      b->need_resync[i] = 0;
-      b->ff_supported[i] = 0;
-      b->rw[i] = 0;
-      b->ff_id[i] = -1;
-      b->ff_until_ms[i] = 0;
-      continue;
+    int btn_idx = linux_button_slot_by_code(b, i, code);
+    if (btn_idx >= 0) {
+      linux_state_begin(b);
+      b->buttons_pressed[i][(uint8_t)btn_idx] = (uint8_t)((ev->value == 1) ? 1 : 0);
+      linux_state_end(b, i);
     }
+    moon_gamepad_event_t out;
+    out.tag = (ev->value == 1) ? MOON_GAMEPAD_EV_BUTTON_PRESSED : MOON_GAMEPAD_EV_BUTTON_RELEASED;
+    out.id = id;
+    out.code = code;
+    out.pad = 0;
+    out.value = (ev->value == 1) ? 1.0 : 0.0;
+    out.time_ms = t;
+    backend_emit(b, out);
+  } else if (ev->type == EV_ABS) {
+    uint32_t code = map_linux_abs((uint16_t)ev->code);
+    if (code == UINT32_MAX) {
+      return;
+    }
+    int axis_idx = linux_axis_slot_by_code(b, i, code);
+    if (axis_idx >= 0) {
+      linux_state_begin(b);
+      b->axes_value[i][(uint8_t)axis_idx] = (int32_t)ev->value;
+      linux_state_end(b, i);
+    }
+    moon_gamepad_event_t out = {
+        MOON_GAMEPAD_EV_AXIS_CHANGED, id, code, 0, (double)((int32_t)ev->value), t};
+    backend_emit(b, out);
   }
-  linux_compact(b);
 }
 
-#endif // __linux__
+static void linux_service_idx(moon_gamepad_backend_t *b, uint32_t i, int hangup, int readable) {
+  if (hangup) {
+    linux_release_idx(b, i);
+    return;
+  }
+  if (!readable) {
+    return;
+  }
+  struct input_event ev;
+  ssize_t r;
+  while ((r = read(b->fds[i], &ev, sizeof(ev))) == (ssize_t)sizeof(ev)) {
+    linux_handle_input_event(b, i, &ev);
+  }
+  if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    linux_release_idx(b, i);
+  }
+}
+
+static int linux_idx_by_fd(moon_gamepad_backend_t *b, int fd) {
+  for (uint32_t i = 0; i < b->fds_len; i++) {
+    if (b->fds[i] == fd) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+static void linux_drain_fd(int fd) {
+  uint8_t buf[4096];
+  while (read(fd, buf, sizeof(buf)) > 0) {
+  }
+}
+
+static void linux_reader_lock(moon_gamepad_backend_t *b) {
+  if (b->reader_shared || b->reader_running || b->ff_sched_running) {
+    pthread_mutex_lock(&b->reader_mu);
+  }
+}
+
+static void linux_reader_unlock(moon_gamepad_backend_t *b) {
+  if (b->reader_shared || b->reader_running || b->ff_sched_running) {
+    pthread_mutex_unlock(&b->reader_mu);
+  }
+}
+
+// The queues and the subscriber list are locked under the same conditions
+// as reader_mu. Called before a thread starts and after it is joined.
+static void linux_sync_locked(moon_gamepad_backend_t *b) {
+  backend_set_locked(b, b->reader_shared || b->reader_running || b->ff_sched_running);
+}
+
+static void linux_backend_poll_timeout(moon_gamepad_backend_t *b, int32_t timeout_ms) {
+  if (b == NULL) {
+    return;
+  }
+  linux_reader_lock(b);
+  // The poll() fallback does not watch the FF timer, so it needs the bound
+  // as much as a backend without one.
+  if (b->ff_timer_fd < 0 || b->epoll_fd < 0) {
+    timeout_ms = linux_ff_bound_timeout(b, timeout_ms);
+  }
+  if ((b->hotplug_fd < 0 || b->epoll_fd < 0) && b->fake == NULL) {
+    // No inotify/epoll: best-effort rescan for hotplug on every poll. Fake
+    // pads are never hotplugged.
+    linux_backend_scan(b, 1);
+    linux_compact(b);
+  }
+  linux_reader_unlock(b);
+  if (b->epoll_fd >= 0) {
+    struct epoll_event evs[MOON_GAMEPAD_LINUX_MAX_DEVICES + 5];
+    int n = epoll_wait(b->epoll_fd, evs, (int)(sizeof(evs) / sizeof(evs[0])), timeout_ms);
+    linux_reader_lock(b);
+    for (int k = 0; k < n; k++) {
+      int fd = evs[k].data.fd;
+      if (fd == b->hotplug_fd) {
+        linux_drain_fd(fd);
+        if (b->probe == NULL) {
+          linux_backend_scan(b, 1);
+        }
+        continue;
+      }
+      if (fd == b->probe_fd) {
+        linux_probe_finish(b, 1);
+        continue;
+      }
+      if (linux_uring_is_fd(b, fd)) {
+        linux_uring_reap(b);
+        continue;
+      }
+      if (fd == b->reader_wake_fd) {
+        linux_drain_fd(fd);
+        continue;
+      }
+      if (fd == b->ff_timer_fd) {
+        linux_drain_fd(fd);
+        b->ff_timer_deadline_ms = 0;
+        linux_ff_tick(b, now_ms());
+        linux_ff_timer_rearm(b);
+        continue;
+      }
+      int i = linux_idx_by_fd(b, fd);
+      if (i < 0) {
+        continue;
+      }
+      linux_service_idx(b, (uint32_t)i, (evs[k].events & (EPOLLERR | EPOLLHUP)) != 0,
+                        (evs[k].events & EPOLLIN) != 0);
+    }
+    if (b->ff_timer_fd < 0) {
+      linux_ff_tick_due(b);
+    }
+    for (uint32_t i = 0; i < b->fds_len; i++) {
+      if (b->fds[i] >= 0 && b->hung_up[i]) {
+        linux_release_idx(b, i);
+      }
+    }
+    linux_compact(b);
+    linux_reader_unlock(b);
+    return;
+  }
+  if (b->fds_len == 0) {
+    return;
+  }
+  struct pollfd pfds[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  for (uint32_t i = 0; i < b->fds_len; i++) {
+    pfds[i].fd = b->fds[i];
+    pfds[i].events = POLLIN | POLLERR | POLLHUP | POLLNVAL;
+    pfds[i].revents = 0;
+  }
+  int n = poll(pfds, (nfds_t)b->fds_len, timeout_ms);
+  linux_ff_tick_due(b);
+  if (n <= 0) {
+    return;
+  }
+  for (uint32_t i = 0; i < b->fds_len; i++) {
+    linux_service_idx(b, i, (pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0,
+                      (pfds[i].revents & POLLIN) != 0);
+  }
+  linux_compact(b);
+}
+
+// -----------------------------------------------------------------------------
+// Low-latency reader thread (Linux)
+// -----------------------------------------------------------------------------
+//
+// Opt-in: a dedicated thread busy-polls every device fd with non-blocking
+// reads and backs off when idle, so input is decoded without waiting for the
+// owner to call poll. Hotplug, hang-up release and force feedback stay on the
+// owning thread.
+
+enum {
+  MOON_GAMEPAD_READER_RUNNING = 1,
+  MOON_GAMEPAD_READER_PINNED = 2,
+  MOON_GAMEPAD_READER_REALTIME = 4,
+  MOON_GAMEPAD_READER_NICED = 8,
+};
+
+static void linux_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+// Spin first, then yield, then sleep 1 us doubling up to ~1 ms.
+static void linux_reader_backoff(uint32_t idle) {
+  if (idle < 64) {
+    linux_cpu_relax();
+    return;
+  }
+  if (idle < 128) {
+    sched_yield();
+    return;
+  }
+  uint32_t shift = idle - 128;
+  struct timespec ts = {0, 1000L << (shift > 10 ? 10 : shift)};
+  nanosleep(&ts, NULL);
+}
+
+// Falls back from SCHED_FIFO to a raised nice value to normal scheduling.
+static int32_t linux_reader_apply_sched(moon_gamepad_backend_t *b) {
+  int32_t status = MOON_GAMEPAD_READER_RUNNING;
+  if (b->reader_cpu >= 0 && b->reader_cpu < CPU_SETSIZE) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(b->reader_cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+      status |= MOON_GAMEPAD_READER_PINNED;
+    }
+  }
+  if (b->reader_realtime) {
+    struct sched_param sp;
+    memset(&sp, 0, sizeof(sp));
+    sp.sched_priority = sched_get_priority_min(SCHED_FIFO) + 10;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp) == 0) {
+      status |= MOON_GAMEPAD_READER_REALTIME;
+    } else if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), -10) == 0) {
+      status |= MOON_GAMEPAD_READER_NICED;
+    }
+  }
+  return status;
+}
+
+static void *linux_reader_main(void *arg) {
+  moon_gamepad_backend_t *b = (moon_gamepad_backend_t *)arg;
+  __atomic_store_n(&b->reader_status, linux_reader_apply_sched(b), __ATOMIC_RELEASE);
+  uint32_t idle = 0;
+  struct input_event evs[32];
+  while (!__atomic_load_n(&b->reader_stop, __ATOMIC_ACQUIRE)) {
+    int got = 0;
+    int hung = 0;
+    pthread_mutex_lock(&b->reader_mu);
+    for (uint32_t i = 0; i < b->fds_len; i++) {
+      if (b->fds[i] < 0 || b->hung_up[i]) {
+        continue;
+      }
+      ssize_t r = read(b->fds[i], evs, sizeof(evs));
+      if (r > 0) {
+        uint32_t n = (uint32_t)r / (uint32_t)sizeof(struct input_event);
+        for (uint32_t k = 0; k < n; k++) {
+          linux_handle_input_event(b, i, &evs[k]);
+        }
+        got = 1;
+      } else if (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        // Released by the owning thread on its next poll.
+        b->hung_up[i] = 1;
+        hung = 1;
+      }
+    }
+    pthread_mutex_unlock(&b->reader_mu);
+    if (hung) {
+      uint64_t one = 1;
+      (void)!write(b->reader_wake_fd, &one, sizeof(one));
+    }
+    if (got) {
+      idle = 0;
+    } else {
+      linux_reader_backoff(idle);
+      if (idle < 1024) {
+        idle++;
+      }
+    }
+  }
+  return NULL;
+}
+
+static int32_t linux_reader_start(moon_gamepad_backend_t *b, int32_t cpu, int32_t realtime) {
+  if (b->reader_running) {
+    return __atomic_load_n(&b->reader_status, __ATOMIC_ACQUIRE);
+  }
+  if (b->epoll_fd < 0) {
+    return 0;
+  }
+  // The reader does its own non-blocking reads; io_uring wants blocking fds.
+  linux_uring_close(b);
+  b->reader_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (b->reader_wake_fd < 0) {
+    return 0;
+  }
+  b->reader_cpu = cpu;
+  b->reader_realtime = realtime;
+  b->reader_status = 0;
+  b->reader_stop = 0;
+  for (uint32_t i = 0; i < b->fds_len; i++) {
+    b->hung_up[i] = 0;
+    linux_epoll_del(b, b->fds[i]);
+  }
+  linux_epoll_add(b, b->reader_wake_fd);
+  b->reader_running = 1;
+  linux_sync_locked(b);
+  if (pthread_create(&b->reader, NULL, linux_reader_main, b) != 0) {
+    b->reader_running = 0;
+    linux_sync_locked(b);
+    linux_epoll_del(b, b->reader_wake_fd);
+    close(b->reader_wake_fd);
+    b->reader_wake_fd = -1;
+    for (uint32_t i = 0; i < b->fds_len; i++) {
+      if (b->fds[i] >= 0) {
+        linux_watch_idx(b, i);
+      }
+    }
+    return 0;
+  }
+  // Wait (bounded) for the thread to report the affinity and policy it got.
+  for (int spins = 0; spins < 1000 && __atomic_load_n(&b->reader_status, __ATOMIC_ACQUIRE) == 0; spins++) {
+    struct timespec ts = {0, 100000L};
+    nanosleep(&ts, NULL);
+  }
+  return __atomic_load_n(&b->reader_status, __ATOMIC_ACQUIRE);
+}
+
+static void linux_reader_stop(moon_gamepad_backend_t *b) {
+  if (!b->reader_running) {
+    return;
+  }
+  __atomic_store_n(&b->reader_stop, 1, __ATOMIC_RELEASE);
+  pthread_join(b->reader, NULL);
+  b->reader_running = 0;
+  b->reader_status = 0;
+  linux_sync_locked(b);
+  linux_epoll_del(b, b->reader_wake_fd);
+  close(b->reader_wake_fd);
+  b->reader_wake_fd = -1;
+  linux_reader_lock(b);
+  for (uint32_t i = 0; i < b->fds_len; i++) {
+    if (b->fds[i] < 0) {
+      continue;
+    }
+    if (b->hung_up[i]) {
+      linux_release_idx(b, i);
+    } else {
+      linux_watch_idx(b, i);
+    }
+  }
+  linux_compact(b);
+  linux_reader_unlock(b);
+}
+
+// Highest scheduler rate, and the rumble window each step renews so a device
+// stops on its own within the window if the thread goes away.
+#define MOON_GAMEPAD_FF_SCHED_HZ_MAX 1000
+#define MOON_GAMEPAD_FF_SCHED_WINDOW_MS 100
+
+int64_t moon_gamepad_now_ms(void);
+static int idx_by_id_u32(const uint32_t *ids, uint32_t len, uint32_t id);
+static uint16_t amp_to_u16(double x);
+static void backend_rumble_mix(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub, uint32_t id,
+                               uint16_t *strong, uint16_t *weak, int32_t *duration_ms);
+
+// Envelope and replay gate of one record at time t, matching
+// BaseEffect::magnitude_at with ms in place of ticks.
+static double linux_ff_sched_level(const linux_ff_sched_rec_t *r, int64_t t) {
+  if (t < r->start_ms || (r->end_ms != 0 && t >= r->end_ms)) {
+    return 0.0;
+  }
+  int64_t rel = t - r->start_ms;
+  int64_t dur = r->play_for_ms + r->with_delay_ms;
+  if (rel < r->after_ms || dur <= 0) {
+    return 0.0;
+  }
+  int64_t w = (rel - r->after_ms) % dur;
+  if (w >= r->play_for_ms) {
+    return 0.0;
+  }
+  if (w < r->attack_ms) {
+    return r->attack_level + (double)w * (1.0 - r->attack_level) / (double)r->attack_ms;
+  }
+  if (w + r->fade_ms > r->play_for_ms) {
+    return 1.0 + (double)(w + r->fade_ms - r->play_for_ms) * (r->fade_level - 1.0) / (double)r->fade_ms;
+  }
+  return 1.0;
+}
+
+static uint16_t linux_ff_sched_u16(double v) {
+  if (!(v > 0.0)) {
+    return 0;
+  }
+  return v >= 65535.0 ? 0xFFFF : (uint16_t)v;
+}
+
+// Sends one subscriber's level on a device, mixed with the others' shares.
+// Caller holds reader_mu.
+static void linux_ff_sched_drive(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub, uint32_t id,
+                                 double strong, double weak) {
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, id);
+  if (idx < 0) {
+    return;
+  }
+  uint16_t s = linux_ff_sched_u16(strong);
+  uint16_t w = linux_ff_sched_u16(weak);
+  int32_t duration_ms = MOON_GAMEPAD_FF_SCHED_WINDOW_MS;
+  backend_rumble_mix(b, sub, id, &s, &w, &duration_ms);
+  (void)linux_ff_set_rumble_idx(b, (uint32_t)idx, s, w, duration_ms);
+}
+
+// The target for (`sub`, `id`) among the first `*n` of `t`, appended when
+// missing. NULL when `t` is full.
+static linux_ff_sched_target_t *linux_ff_sched_target(linux_ff_sched_target_t *t, uint32_t *n,
+                                                      moon_gamepad_subscriber_t *sub, uint32_t id) {
+  for (uint32_t k = 0; k < *n; k++) {
+    if (t[k].sub == sub && t[k].id == id) {
+      return &t[k];
+    }
+  }
+  if (*n == MOON_GAMEPAD_FF_SCHED_TARGETS) {
+    return NULL;
+  }
+  linux_ff_sched_target_t *out = &t[(*n)++];
+  out->sub = sub;
+  out->id = id;
+  out->strong = 0.0;
+  out->weak = 0.0;
+  return out;
+}
+
+// Caller holds ff_sched_mu.
+static int linux_ff_sched_is_user(const moon_gamepad_backend_t *b, const moon_gamepad_subscriber_t *sub) {
+  for (uint32_t i = 0; i < b->ff_sched_users_len; i++) {
+    if (b->ff_sched_users[i] == sub) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Consumes the samples due by `now_ns` and returns the loudest of them; with
+// none due the previous level holds. Running dry ends the stream, counting
+// one underrun unless the producer ended it. Caller holds ff_sched_mu.
+static uint16_t linux_ff_stream_step(linux_ff_stream_t *st, int64_t now_ns) {
+  st->due += (double)(now_ns - st->last_ns) * (double)st->rate / 1e9;
+  st->last_ns = now_ns;
+  uint32_t want = (uint32_t)st->due;
+  st->due -= (double)want;
+  if (want == 0) {
+    return st->level;
+  }
+  if (want > st->len) {
+    if (st->len == 0) {
+      if (!st->ending) {
+        st->underruns++;
+      }
+      st->ending = 0;
+      st->active = 0;
+      st->level = 0;
+      st->due = 0.0;
+      return 0;
+    }
+    want = st->len;
+  }
+  uint16_t peak = 0;
+  for (uint32_t k = 0; k < want; k++) {
+    uint16_t v = st->ring[(st->head + k) % MOON_GAMEPAD_FF_STREAM_CAP];
+    if (v > peak) {
+      peak = v;
+    }
+  }
+  st->head = (st->head + want) % MOON_GAMEPAD_FF_STREAM_CAP;
+  st->len -= want;
+  st->played += want;
+  st->level = peak;
+  return peak;
+}
+
+static linux_ff_stream_t *linux_ff_stream_find(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub,
+                                               uint32_t id, int alloc) {
+  linux_ff_stream_t *idle = NULL;
+  for (uint32_t i = 0; i < MOON_GAMEPAD_FF_STREAM_MAX; i++) {
+    linux_ff_stream_t *st = &b->ff_streams[i];
+    if (st->used && st->sub == sub && st->id == id) {
+      return st;
+    }
+    if (idle == NULL && (!st->used || (!st->active && st->len == 0))) {
+      idle = st;
+    }
+  }
+  if (!alloc || idle == NULL) {
+    return NULL;
+  }
+  memset(idle, 0, sizeof(*idle));
+  idle->used = 1;
+  idle->sub = sub;
+  idle->id = id;
+  return idle;
+}
+
+// Queues `count` amplitude samples in 0..=1 for device `id`. Returns how
+// many were queued, 0 when `sub` does not use the scheduler or no stream
+// slot is free.
+static int32_t linux_ff_stream_push(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub, uint32_t id,
+                                    const double *samples, int32_t count, int32_t rate) {
+  pthread_mutex_lock(&b->ff_sched_mu);
+  linux_ff_stream_t *st = linux_ff_sched_is_user(b, sub) ? linux_ff_stream_find(b, sub, id, 1) : NULL;
+  if (st == NULL) {
+    pthread_mutex_unlock(&b->ff_sched_mu);
+    return 0;
+  }
+  uint32_t max = (uint32_t)((int64_t)rate * MOON_GAMEPAD_FF_STREAM_LATENCY_MS / 1000);
+  if (max == 0) {
+    max = 1;
+  }
+  if (max > MOON_GAMEPAD_FF_STREAM_CAP) {
+    max = MOON_GAMEPAD_FF_STREAM_CAP;
+  }
+  if ((uint32_t)count > max) {
+    st->dropped += (uint32_t)count - max;
+    samples += (uint32_t)count - max;
+    count = (int32_t)max;
+  }
+  if (st->len + (uint32_t)count > max) {
+    uint32_t drop = st->len + (uint32_t)count - max;
+    st->head = (st->head + drop) % MOON_GAMEPAD_FF_STREAM_CAP;
+    st->len -= drop;
+    st->dropped += drop;
+  }
+  for (int32_t k = 0; k < count; k++) {
+    st->ring[(st->head + st->len) % MOON_GAMEPAD_FF_STREAM_CAP] = amp_to_u16(samples[k]);
+    st->len++;
+  }
+  st->rate = rate;
+  st->ending = 0;
+  if (!st->active && count > 0) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    st->last_ns = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    st->due = 0.0;
+    st->active = 1;
+  }
+  pthread_mutex_unlock(&b->ff_sched_mu);
+  return count;
+}
+
+// Marks the end of `sub`'s stream on device `id`: what is queued still
+// plays, then the stream stops without an underrun. Returns 0 without an
+// active stream.
+static int32_t linux_ff_stream_end(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub, uint32_t id) {
+  pthread_mutex_lock(&b->ff_sched_mu);
+  linux_ff_stream_t *st = linux_ff_stream_find(b, sub, id, 0);
+  int32_t ok = st != NULL && st->active;
+  if (ok) {
+    st->ending = 1;
+  }
+  pthread_mutex_unlock(&b->ff_sched_mu);
+  return ok;
+}
+
+static void *linux_ff_sched_main(void *arg) {
+  moon_gamepad_backend_t *b = (moon_gamepad_backend_t *)arg;
+  linux_ff_sched_target_t targets[MOON_GAMEPAD_FF_SCHED_TARGETS];
+  linux_ff_sched_target_t withdrawn[MOON_GAMEPAD_FF_SCHED_TARGETS];
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (!__atomic_load_n(&b->ff_sched_stop, __ATOMIC_ACQUIRE)) {
+    long period_ns = 1000000000L / __atomic_load_n(&b->ff_sched_hz, __ATOMIC_ACQUIRE);
+    next.tv_nsec += period_ns;
+    while (next.tv_nsec >= 1000000000L) {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > next.tv_sec + 1) {
+      // Fell far behind (suspend, debugger): restart the grid from now.
+      next = now;
+    }
+    int64_t t = moon_gamepad_now_ms();
+    int64_t now_ns = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+    uint32_t n = 0;
+    uint32_t gone = 0;
+    // Levels are mixed under ff_sched_mu alone; reader_mu is only taken per
+    // upload below, so the reader thread is not held off for a whole step.
+    pthread_mutex_lock(&b->ff_sched_mu);
+    for (uint32_t i = 0; i < b->ff_sched_len; i++) {
+      const linux_ff_sched_rec_t *r = &b->ff_sched_recs[i];
+      linux_ff_sched_target_t *tg = linux_ff_sched_target(targets, &n, r->sub, r->id);
+      if (tg == NULL) {
+        continue;
+      }
+      double v = (double)r->magnitude * r->attenuation * linux_ff_sched_level(r, t);
+      if (r->strong) {
+        tg->strong += v;
+      } else {
+        tg->weak += v;
+      }
+    }
+    for (uint32_t i = 0; i < MOON_GAMEPAD_FF_STREAM_MAX; i++) {
+      linux_ff_stream_t *st = &b->ff_streams[i];
+      if (!st->active) {
+        continue;
+      }
+      double v = (double)linux_ff_stream_step(st, now_ns);
+      linux_ff_sched_target_t *tg = linux_ff_sched_target(targets, &n, st->sub, st->id);
+      if (tg == NULL) {
+        continue;
+      }
+      tg->strong += v;
+      tg->weak += v;
+    }
+    // Targets whose records were withdrawn get one zero request.
+    for (uint32_t j = 0; j < b->ff_sched_driven_len; j++) {
+      const linux_ff_sched_target_t *d = &b->ff_sched_driven[j];
+      uint32_t k = 0;
+      while (k < n && (targets[k].sub != d->sub || targets[k].id != d->id)) {
+        k++;
+      }
+      if (k == n) {
+        withdrawn[gone] = *d;
+        withdrawn[gone].strong = 0.0;
+        withdrawn[gone].weak = 0.0;
+        gone++;
+      }
+    }
+    memcpy(b->ff_sched_driven, targets, n * sizeof(targets[0]));
+    b->ff_sched_driven_len = n;
+    pthread_mutex_unlock(&b->ff_sched_mu);
+    for (uint32_t k = 0; k < n + gone; k++) {
+      const linux_ff_sched_target_t *tg = k < n ? &targets[k] : &withdrawn[k - n];
+      pthread_mutex_lock(&b->reader_mu);
+      // linux_ff_sched_leave needs reader_mu to drop a user, so one still
+      // listed here stays alive until the upload is done.
+      pthread_mutex_lock(&b->ff_sched_mu);
+      int live = linux_ff_sched_is_user(b, tg->sub);
+      pthread_mutex_unlock(&b->ff_sched_mu);
+      if (live) {
+        linux_ff_sched_drive(b, tg->sub, tg->id, tg->strong, tg->weak);
+      }
+      pthread_mutex_unlock(&b->reader_mu);
+    }
+    pthread_mutex_lock(&b->reader_mu);
+    linux_ff_tick_due(b);
+    pthread_mutex_unlock(&b->reader_mu);
+  }
+  return NULL;
+}
+
+// Adds `sub` to the scheduler's users and starts the thread for the first
+// one. Users share one rate, set by the latest call. Returns the rate, 0
+// when the thread cannot start or every user slot is taken.
+static int32_t linux_ff_sched_start(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub, int32_t hz) {
+  if (hz > MOON_GAMEPAD_FF_SCHED_HZ_MAX) {
+    hz = MOON_GAMEPAD_FF_SCHED_HZ_MAX;
+  }
+  pthread_mutex_lock(&b->ff_sched_mu);
+  if (!linux_ff_sched_is_user(b, sub)) {
+    if (b->ff_sched_users_len == MOON_GAMEPAD_MAX_SUBSCRIBERS) {
+      pthread_mutex_unlock(&b->ff_sched_mu);
+      return 0;
+    }
+    b->ff_sched_users[b->ff_sched_users_len++] = sub;
+  }
+  pthread_mutex_unlock(&b->ff_sched_mu);
+  __atomic_store_n(&b->ff_sched_hz, hz, __ATOMIC_RELEASE);
+  if (b->ff_sched_running) {
+    return hz;
+  }
+  b->ff_sched_stop = 0;
+  b->ff_sched_len = 0;
+  b->ff_sched_driven_len = 0;
+  memset(b->ff_streams, 0, sizeof(b->ff_streams));
+  b->ff_sched_running = 1;
+  linux_sync_locked(b);
+  if (pthread_create(&b->ff_sched, NULL, linux_ff_sched_main, b) != 0) {
+    b->ff_sched_running = 0;
+    b->ff_sched_users_len = 0;
+    linux_sync_locked(b);
+    return 0;
+  }
+  return hz;
+}
+
+// Stops the thread for every user. Devices keep their last magnitudes for
+// at most the rumble window.
+static void linux_ff_sched_stop(moon_gamepad_backend_t *b) {
+  if (!b->ff_sched_running) {
+    return;
+  }
+  __atomic_store_n(&b->ff_sched_stop, 1, __ATOMIC_RELEASE);
+  pthread_join(b->ff_sched, NULL);
+  b->ff_sched_running = 0;
+  b->ff_sched_users_len = 0;
+  linux_sync_locked(b);
+  b->ff_sched_len = 0;
+  b->ff_sched_driven_len = 0;
+}
+
+// Withdraws `sub` from the scheduler: its records and streams go, the
+// devices it was driving get one zero request, and the thread stops with
+// the last user. Returns 0 when `sub` was not a user.
+static int linux_ff_sched_leave(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub) {
+  if (!b->ff_sched_running) {
+    return 0;
+  }
+  pthread_mutex_lock(&b->reader_mu);
+  pthread_mutex_lock(&b->ff_sched_mu);
+  int found = 0;
+  for (uint32_t i = 0; i < b->ff_sched_users_len; i++) {
+    if (b->ff_sched_users[i] == sub) {
+      b->ff_sched_users[i] = b->ff_sched_users[--b->ff_sched_users_len];
+      found = 1;
+      break;
+    }
+  }
+  if (found) {
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < b->ff_sched_len; i++) {
+      if (b->ff_sched_recs[i].sub != sub) {
+        b->ff_sched_recs[out++] = b->ff_sched_recs[i];
+      }
+    }
+    b->ff_sched_len = out;
+    for (uint32_t i = 0; i < MOON_GAMEPAD_FF_STREAM_MAX; i++) {
+      if (b->ff_streams[i].used && b->ff_streams[i].sub == sub) {
+        memset(&b->ff_streams[i], 0, sizeof(b->ff_streams[i]));
+      }
+    }
+    out = 0;
+    for (uint32_t j = 0; j < b->ff_sched_driven_len; j++) {
+      linux_ff_sched_target_t *d = &b->ff_sched_driven[j];
+      if (d->sub == sub) {
+        linux_ff_sched_drive(b, sub, d->id, 0.0, 0.0);
+      } else {
+        b->ff_sched_driven[out++] = *d;
+      }
+    }
+    b->ff_sched_driven_len = out;
+  }
+  uint32_t left = b->ff_sched_users_len;
+  pthread_mutex_unlock(&b->ff_sched_mu);
+  pthread_mutex_unlock(&b->reader_mu);
+  if (found && left == 0) {
+    linux_ff_sched_stop(b);
+  }
+  return found;
+}
+
+// Replaces `sub`'s records for device `id` with `count` packed entries of
+// MOON_GAMEPAD_FF_SCHED_FIELDS doubles each. Returns how many were kept, 0
+// when `sub` does not use the scheduler.
+static int32_t linux_ff_sched_post(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub, uint32_t id,
+                                   const double *recs, int32_t count) {
+  pthread_mutex_lock(&b->ff_sched_mu);
+  if (!linux_ff_sched_is_user(b, sub)) {
+    pthread_mutex_unlock(&b->ff_sched_mu);
+    return 0;
+  }
+  uint32_t out = 0;
+  for (uint32_t i = 0; i < b->ff_sched_len; i++) {
+    if (b->ff_sched_recs[i].sub != sub || b->ff_sched_recs[i].id != id) {
+      b->ff_sched_recs[out++] = b->ff_sched_recs[i];
+    }
+  }
+  int32_t kept = 0;
+  for (int32_t k = 0; k < count && out < MOON_GAMEPAD_FF_SCHED_MAX; k++) {
+    const double *f = recs + k * MOON_GAMEPAD_FF_SCHED_FIELDS;
+    linux_ff_sched_rec_t *r = &b->ff_sched_recs[out++];
+    r->sub = sub;
+    r->id = id;
+    r->start_ms = (int64_t)f[0];
+    r->end_ms = (int64_t)f[1];
+    r->attenuation = f[2];
+    r->strong = f[3] != 0.0;
+    r->magnitude = linux_ff_sched_u16(f[4]);
+    r->after_ms = (int64_t)f[5];
+    r->play_for_ms = (int64_t)f[6];
+    r->with_delay_ms = (int64_t)f[7];
+    r->attack_ms = (int64_t)f[8];
+    r->attack_level = f[9];
+    r->fade_ms = (int64_t)f[10];
+    r->fade_level = f[11];
+    kept++;
+  }
+  b->ff_sched_len = out;
+  pthread_mutex_unlock(&b->ff_sched_mu);
+  return kept;
+}
+
+#endif // __linux__
 
 #if defined(_WIN32)
 
@@ -2665,7 +5375,7 @@ static void push_btn_edge(moon_gamepad_backend_t *b, uint32_t id, int pressed, u
   ev.pad = 0;
   ev.value = pressed ? 1.0 : 0.0;
   ev.time_ms = t;
-  queue_push(&b->q, ev);
+  backend_emit(b, ev);
 }
 
 static void push_btn_diff_mask(moon_gamepad_backend_t *b, uint32_t id, uint16_t oldv, uint16_t newv,
@@ -2787,7 +5497,7 @@ static void windows_backend_poll(moon_gamepad_backend_t *b) {
       b->win_lt2[idx] = st.Gamepad.bLeftTrigger;
       b->win_rt2[idx] = st.Gamepad.bRightTrigger;
       moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_CONNECTED, idx, 0, 0, 0.0, now_ms()};
-      queue_push(&b->q, ev);
+      backend_emit(b, ev);
       continue;
     }
 
@@ -2798,7 +5508,7 @@ static void windows_backend_poll(moon_gamepad_backend_t *b) {
       b->win_rumble_until_ms[idx] = 0;
       windows_rumble_apply(b, idx, 0, 0);
       moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_DISCONNECTED, idx, 0, 0, 0.0, now_ms()};
-      queue_push(&b->q, ev);
+      backend_emit(b, ev);
       continue;
     }
 
@@ -2842,13 +5552,13 @@ static void windows_backend_poll(moon_gamepad_backend_t *b) {
       b->win_lt2[idx] = st.Gamepad.bLeftTrigger;
       moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_AXIS_CHANGED, idx, CODE_AXIS_LT2, 0,
                                  (double)((int32_t)st.Gamepad.bLeftTrigger), t};
-      queue_push(&b->q, ev);
+      backend_emit(b, ev);
     }
     if (b->win_rt2[idx] != st.Gamepad.bRightTrigger) {
       b->win_rt2[idx] = st.Gamepad.bRightTrigger;
       moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_AXIS_CHANGED, idx, CODE_AXIS_RT2, 0,
                                  (double)((int32_t)st.Gamepad.bRightTrigger), t};
-      queue_push(&b->q, ev);
+      backend_emit(b, ev);
     }
 
     // Sticks -> AxisChanged with raw i16 values.
@@ -2856,32 +5566,33 @@ static void windows_backend_poll(moon_gamepad_backend_t *b) {
       b->win_lx[idx] = st.Gamepad.sThumbLX;
       moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_AXIS_CHANGED, idx, CODE_AXIS_LSTICKX, 0,
                                  (double)((int32_t)st.Gamepad.sThumbLX), t};
-      queue_push(&b->q, ev);
+      backend_emit(b, ev);
     }
     if (b->win_ly[idx] != st.Gamepad.sThumbLY) {
       b->win_ly[idx] = st.Gamepad.sThumbLY;
       moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_AXIS_CHANGED, idx, CODE_AXIS_LSTICKY, 0,
                                  (double)((int32_t)st.Gamepad.sThumbLY), t};
-      queue_push(&b->q, ev);
+      backend_emit(b, ev);
     }
     if (b->win_rx[idx] != st.Gamepad.sThumbRX) {
       b->win_rx[idx] = st.Gamepad.sThumbRX;
       moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_AXIS_CHANGED, idx, CODE_AXIS_RSTICKX, 0,
                                  (double)((int32_t)st.Gamepad.sThumbRX), t};
-      queue_push(&b->q, ev);
+      backend_emit(b, ev);
     }
     if (b->win_ry[idx] != st.Gamepad.sThumbRY) {
       b->win_ry[idx] = st.Gamepad.sThumbRY;
       moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_AXIS_CHANGED, idx, CODE_AXIS_RSTICKY, 0,
                                  (double)((int32_t)st.Gamepad.sThumbRY), t};
-      queue_push(&b->q, ev);
+      backend_emit(b, ev);
     }
   }
   b->gamepad_count = connected_count;
   windows_rumble_tick(b);
 }
 
-static void windows_backend_poll_timeout(moon_gamepad_backend_t *b, int32_t timeout_ms) {
+static void windows_backend_poll_timeout(moon_gamepad_backend_t *b, moon_gamepad_queue_t *wait_q,
+                                         int32_t timeout_ms) {
   if (b == NULL) {
     return;
   }
@@ -2892,7 +5603,7 @@ static void windows_backend_poll_timeout(moon_gamepad_backend_t *b, int32_t time
   int64_t start = now_ms();
   while (1) {
     windows_backend_poll(b);
-    if (queue_len(&b->q) != 0) {
+    if (queue_len(wait_q) != 0) {
       return;
     }
     if (timeout_ms < 0) {
@@ -2975,144 +5686,422 @@ static void windows_power_info(moon_gamepad_backend_t *b, uint32_t idx, int32_t
 // MoonBit extern API
 // -----------------------------------------------------------------------------
 
+typedef struct moon_gamepad_client_t moon_gamepad_client_t;
+
+#if defined(__linux__)
+static void client_detach(moon_gamepad_client_t *c);
+#endif
+
 typedef struct moon_gamepad_backend_owner_payload_t {
   moon_gamepad_backend_t *b;
+  moon_gamepad_subscriber_t *sub;
+  int shared;
+  // Set instead of b/sub when attached to a broker's shared memory.
+  moon_gamepad_client_t *client;
 } moon_gamepad_backend_owner_payload_t;
 
-static void backend_finalize(void *self) {
-  moon_gamepad_backend_owner_payload_t *p = (moon_gamepad_backend_owner_payload_t *)self;
-  if (p == NULL) {
-    return;
-  }
-  if (p->b != NULL) {
-#if defined(__APPLE__)
-    mac_backend_shutdown(p->b);
+// Process-wide backend handed out by moon_gamepad_backend_new_shared.
+// g_shared_mu guards it and every shared backend's shared_refs.
+static moon_gamepad_backend_t *g_shared_backend = NULL;
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+static pthread_mutex_t g_shared_mu = PTHREAD_MUTEX_INITIALIZER;
 #endif
-#if defined(__linux__)
-    linux_backend_shutdown(p->b);
+
+static void shared_lock(void) {
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  pthread_mutex_lock(&g_shared_mu);
 #endif
-#if defined(_WIN32)
-    windows_backend_shutdown(p->b);
+}
+
+static void shared_unlock(void) {
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  pthread_mutex_unlock(&g_shared_mu);
 #endif
-    queue_free(&p->b->q);
-    free(p->b);
-    p->b = NULL;
-  }
 }
 
-void *moon_gamepad_backend_new(void) {
-  moon_gamepad_backend_owner_payload_t *p = (moon_gamepad_backend_owner_payload_t *)moonbit_make_external_object(
-      backend_finalize, (uint32_t)sizeof(*p));
-  if (p == NULL) {
+static moon_gamepad_subscriber_t *subscriber_new(void) {
+  moon_gamepad_subscriber_t *sub = (moon_gamepad_subscriber_t *)calloc(1, sizeof(moon_gamepad_subscriber_t));
+  if (sub == NULL) {
     return NULL;
   }
-  p->b = (moon_gamepad_backend_t *)calloc(1, sizeof(moon_gamepad_backend_t));
-  if (p->b == NULL) {
-    return p;
-  }
-  queue_init(&p->b->q, 1024);
-  p->b->gamepad_count = 0;
+  queue_init(&sub->q, 1024);
+  queue_init_plain(&sub->hi, 64);
+  sub->ready_fd = -1;
+  return sub;
+}
 
-#if defined(__APPLE__)
-  mac_backend_init(p->b);
-#elif defined(__linux__)
-  linux_backend_init(p->b);
-#elif defined(_WIN32)
-  windows_backend_init(p->b);
+static int subscriber_ready_fd(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub) {
+#if defined(__linux__)
+  if (sub->ready_fd >= 0) {
+    return sub->ready_fd;
+  }
+  if (b->epoll_fd < 0) {
+    return sub->q.notify_rd;
+  }
+  // Readable when either the device set or this subscriber's queue is.
+  sub->ready_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (sub->ready_fd < 0) {
+    return b->epoll_fd;
+  }
+  int fds[2] = {b->epoll_fd, sub->q.notify_rd};
+  for (int i = 0; i < 2; i++) {
+    if (fds[i] < 0) {
+      continue;
+    }
+    struct epoll_event ee;
+    memset(&ee, 0, sizeof(ee));
+    ee.events = EPOLLIN;
+    ee.data.fd = fds[i];
+    (void)epoll_ctl(sub->ready_fd, EPOLL_CTL_ADD, fds[i], &ee);
+  }
+  return sub->ready_fd;
+#elif defined(__APPLE__)
+  (void)b;
+  return sub->q.notify_rd;
 #else
-  // Other native targets: not implemented.
-  (void)p;
+  (void)b;
+  (void)sub;
+  return -1;
 #endif
-  return p;
 }
 
-void *moon_gamepad_backend_new_null_for_test(void) {
-  return NULL;
+#if defined(__linux__)
+// While the reader thread decodes input, block on the subscriber's queue and
+// the epoll set (hotplug, FF timer, hang-ups) rather than on device fds.
+static void linux_poll_subscriber(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub,
+                                  int32_t timeout_ms) {
+  // Another subscriber may already have decoded events into this queue.
+  if (queue_len(&sub->q) != 0) {
+    timeout_ms = 0;
+  }
+  if (b->reader_running && timeout_ms != 0) {
+    struct pollfd pfds[2] = {
+        {subscriber_ready_fd(b, sub), POLLIN, 0},
+        {b->epoll_fd, POLLIN, 0},
+    };
+    (void)poll(pfds, 2, timeout_ms);
+    timeout_ms = 0;
+  }
+  linux_backend_poll_timeout(b, timeout_ms);
 }
+#endif
 
-moonbit_string_t moon_gamepad_uuid_simple_from_ids(
-    int32_t bustype,
-    int32_t vendor,
-    int32_t product,
-    int32_t version) {
-  char out33[33];
-  uuid_simple_from_ids(
-      (uint16_t)bustype,
-      (uint16_t)vendor,
-      (uint16_t)product,
-      (uint16_t)version,
-      out33);
-  return moonbit_string_from_utf8_lossy(out33);
+static void subscriber_free(moon_gamepad_subscriber_t *sub) {
+  if (sub == NULL) {
+    return;
+  }
+#if defined(__linux__)
+  if (sub->ready_fd >= 0) {
+    close(sub->ready_fd);
+  }
+#endif
+  for (uint32_t i = 0; i < sub->dev_len; i++) {
+    queue_free(sub->dev_q[i]);
+    free(sub->dev_q[i]);
+  }
+  queue_free(&sub->hi);
+  queue_free(&sub->q);
+  free(sub);
 }
 
-int64_t moon_gamepad_now_ms(void) {
-  if (g_now_ms_override_for_test >= 0) {
-    return g_now_ms_override_for_test;
+static int backend_subscribe(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub) {
+  int ok = 0;
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  // Not reachable by producers until it is in the list.
+  subscriber_set_locked(sub, b->locked);
+#endif
+  int held = backend_subs_lock(b);
+  if (b->subs_len < MOON_GAMEPAD_MAX_SUBSCRIBERS) {
+    b->subs[b->subs_len++] = sub;
+    ok = 1;
+  }
+  backend_subs_unlock(b, held);
+  return ok;
+}
+
+static void backend_unsubscribe(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub) {
+  int held = backend_subs_lock(b);
+  for (uint32_t i = 0; i < b->subs_len; i++) {
+    if (b->subs[i] == sub) {
+      b->subs[i] = b->subs[b->subs_len - 1];
+      b->subs[b->subs_len - 1] = NULL;
+      b->subs_len--;
+      break;
+    }
   }
-  return now_ms();
+  backend_subs_unlock(b, held);
 }
 
-moonbit_string_t moon_gamepad_env_sdl_gamecontrollerconfig(void) {
-  return moonbit_string_from_utf8_lossy(getenv("SDL_GAMECONTROLLERCONFIG"));
+static moon_gamepad_backend_t *backend_create(void) {
+  moon_gamepad_backend_t *b = (moon_gamepad_backend_t *)calloc(1, sizeof(moon_gamepad_backend_t));
+  if (b == NULL) {
+    return NULL;
+  }
+  b->subs_len = 0;
+  b->gamepad_count = 0;
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  pthread_mutex_init(&b->subs_mu, NULL);
+#if defined(__APPLE__)
+  b->locked = 1;
+#endif
+#endif
+#if defined(__linux__)
+  pthread_mutex_init(&b->reader_mu, NULL);
+  pthread_mutex_init(&b->ff_sched_mu, NULL);
+  b->reader_wake_fd = -1;
+  b->probe_fd = -1;
+#endif
+  return b;
 }
 
-moonbit_string_t moon_gamepad_sdl_platform_name(void) {
+static void backend_start(moon_gamepad_backend_t *b) {
 #if defined(__APPLE__)
-  return moonbit_string_from_utf8_lossy("Mac OS X");
+  mac_backend_init(b);
 #elif defined(__linux__)
-  return moonbit_string_from_utf8_lossy("Linux");
+  linux_backend_init(b);
 #elif defined(_WIN32)
-  return moonbit_string_from_utf8_lossy("Windows");
+  windows_backend_init(b);
 #else
-  return moonbit_string_from_utf8_lossy("");
+  // Other native targets: not implemented.
+  (void)b;
 #endif
 }
 
-void moon_gamepad_set_sdl_gamecontrollerconfig_for_test(moonbit_string_t value) {
-  char *v = moonbit_string_to_ascii_cstr(value);
-  if (v == NULL) {
+static void backend_destroy(moon_gamepad_backend_t *b) {
+  if (b == NULL) {
     return;
   }
+#if defined(__APPLE__)
+  mac_backend_shutdown(b);
+#endif
+#if defined(__linux__)
+  linux_backend_shutdown(b);
+#endif
 #if defined(_WIN32)
-  _putenv_s("SDL_GAMECONTROLLERCONFIG", v);
-#else
-  setenv("SDL_GAMECONTROLLERCONFIG", v, 1);
+  windows_backend_shutdown(b);
 #endif
-  free(v);
+#if defined(MOON_GAMEPAD_QUEUE_LOCKED)
+  pthread_mutex_destroy(&b->subs_mu);
+#endif
+#if defined(__linux__)
+  pthread_mutex_destroy(&b->reader_mu);
+  pthread_mutex_destroy(&b->ff_sched_mu);
+#endif
+  free(b);
 }
 
-void moon_gamepad_clear_sdl_gamecontrollerconfig_for_test(void) {
-#if defined(_WIN32)
-  _putenv_s("SDL_GAMECONTROLLERCONFIG", "");
+static void backend_finalize(void *self) {
+  moon_gamepad_backend_owner_payload_t *p = (moon_gamepad_backend_owner_payload_t *)self;
+  if (p == NULL) {
+    return;
+  }
+  if (p->b != NULL) {
+#if defined(__linux__)
+    (void)linux_ff_sched_leave(p->b, p->sub);
+    linux_reader_lock(p->b);
+    linux_ff_offload_forget(p->b, p->sub);
+    linux_reader_unlock(p->b);
+#endif
+    backend_unsubscribe(p->b, p->sub);
+    int last = 1;
+    if (p->shared) {
+      shared_lock();
+      last = (--p->b->shared_refs == 0);
+      if (last && g_shared_backend == p->b) {
+        g_shared_backend = NULL;
+      }
+      shared_unlock();
+    }
+    if (last) {
+      backend_destroy(p->b);
+    }
+    p->b = NULL;
+  }
+  subscriber_free(p->sub);
+  p->sub = NULL;
+#if defined(__linux__)
+  client_detach(p->client);
+#endif
+  p->client = NULL;
+}
+
+static moon_gamepad_backend_owner_payload_t *backend_owner_alloc(int shared) {
+  moon_gamepad_backend_owner_payload_t *p = (moon_gamepad_backend_owner_payload_t *)moonbit_make_external_object(
+      backend_finalize, (uint32_t)sizeof(*p));
+  if (p == NULL) {
+    return NULL;
+  }
+  p->b = NULL;
+  p->sub = NULL;
+  p->shared = shared;
+  p->client = NULL;
+  return p;
+}
+
+static void *backend_new_owner(int async_probe, const char *filter_spec) {
+  moon_gamepad_backend_owner_payload_t *p = backend_owner_alloc(0);
+  if (p == NULL) {
+    return NULL;
+  }
+  moon_gamepad_backend_t *b = backend_create();
+  if (b == NULL) {
+    return p;
+  }
+  p->sub = subscriber_new();
+  if (p->sub == NULL) {
+    backend_destroy(b);
+    return p;
+  }
+  // Subscribe before starting so events raised during init are not lost.
+  (void)backend_subscribe(b, p->sub);
+#if defined(__linux__)
+  b->async_probe = async_probe;
+  if (filter_spec != NULL) {
+    linux_filter_parse(&b->filter, filter_spec);
+  }
 #else
-  unsetenv("SDL_GAMECONTROLLERCONFIG");
+  (void)async_probe;
+  (void)filter_spec;
 #endif
+  backend_start(b);
+  p->b = b;
+  return p;
 }
 
-void moon_gamepad_now_ms_set_for_test(int64_t ms) {
-  g_now_ms_override_for_test = ms;
+void *moon_gamepad_backend_new(void) {
+  return backend_new_owner(0, NULL);
 }
 
-void moon_gamepad_now_ms_clear_for_test(void) {
-  g_now_ms_override_for_test = -1;
+// Like moon_gamepad_backend_new, but on Linux devices are opened and probed on
+// a helper thread and show up later as Connected events.
+void *moon_gamepad_backend_new_async(void) {
+  return backend_new_owner(1, NULL);
 }
 
-int32_t moon_gamepad_macos_hat_pack_for_test(int32_t hat_v, int32_t hat_min, int32_t hat_max) {
-#if defined(__APPLE__)
-  int32_t x_raw = 0;
-  int32_t y_raw = 0;
-  mac_hat_to_xy_raw(hat_v, hat_min, hat_max, &x_raw, &y_raw);
-  int32_t x_pack = (x_raw + 2) & 0x3;
-  int32_t y_pack = (y_raw + 2) & 0x3;
-  return x_pack | (y_pack << 2);
-#else
-  (void)hat_v;
-  (void)hat_min;
-  (void)hat_max;
-  return 0;
+// A private backend that only opens devices accepted by `spec` (see
+// linux_filter_parse). Filters are ignored on other platforms.
+void *moon_gamepad_backend_new_filtered(moonbit_string_t spec, int32_t async_probe) {
+  char *s = moonbit_string_to_ascii_cstr(spec);
+  void *p = backend_new_owner(async_probe, s != NULL ? s : "");
+  free(s);
+  return p;
+}
+
+// Subscribes `p` to the shared backend `b`. Fails once `b` already has
+// MOON_GAMEPAD_MAX_SUBSCRIBERS subscribers. The caller holds g_shared_mu.
+static int backend_share_locked(moon_gamepad_backend_owner_payload_t *p, moon_gamepad_backend_t *b) {
+  p->sub = subscriber_new();
+  if (p->sub == NULL || !backend_subscribe(b, p->sub)) {
+    subscriber_free(p->sub);
+    p->sub = NULL;
+    return 0;
+  }
+  b->shared_refs++;
+#if defined(__linux__)
+  b->reader_shared = 1;
+  linux_sync_locked(b);
 #endif
+  p->b = b;
+  return 1;
+}
+
+// The returned owner has no backend (see moon_gamepad_backend_is_live) when
+// the shared backend is out of subscriber slots.
+void *moon_gamepad_backend_new_shared(void) {
+  moon_gamepad_backend_owner_payload_t *p = backend_owner_alloc(1);
+  if (p == NULL) {
+    return NULL;
+  }
+  shared_lock();
+  moon_gamepad_backend_t *b = g_shared_backend;
+  int fresh = (b == NULL);
+  if (fresh) {
+    b = backend_create();
+  }
+  if (b != NULL && backend_share_locked(p, b)) {
+    if (fresh) {
+      g_shared_backend = b;
+      backend_start(b);
+    }
+  } else if (fresh) {
+    free(b);
+  }
+  shared_unlock();
+  return p;
+}
+
+int32_t moon_gamepad_backend_is_live(void *owner) {
+  moon_gamepad_backend_owner_payload_t *p = (moon_gamepad_backend_owner_payload_t *)owner;
+  return (p != NULL && (p->b != NULL || p->client != NULL)) ? 1 : 0;
+}
+
+void *moon_gamepad_backend_new_null_for_test(void) {
+  return NULL;
 }
 
+void moon_gamepad_backend_inject_event_for_test(void *owner, int32_t tag, int32_t id, int32_t code,
+                                                double value) {
+  moon_gamepad_backend_owner_payload_t *p = (moon_gamepad_backend_owner_payload_t *)owner;
+  if (p == NULL || p->b == NULL) {
+    return;
+  }
+  moon_gamepad_event_t ev = {(uint32_t)tag, (uint32_t)id, (uint32_t)code, 0, value, now_ms()};
+  backend_emit(p->b, ev);
+}
+
+#if defined(__linux__)
+// Brings `b` up like linux_backend_init, but over `devices` pipe-backed pads
+// with every mapped button and axis instead of the nodes in /dev/input.
+static void linux_fake_init(moon_gamepad_backend_t *b, int32_t devices) {
+  linux_reset_tables(b);
+  b->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  b->ff_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  b->hotplug_fd = -1;
+  linux_epoll_add(b, b->ff_timer_fd);
+  b->fake = (linux_fake_t *)calloc(1, sizeof(linux_fake_t));
+  if (b->fake == NULL) {
+    return;
+  }
+  for (int32_t n = 0; n < devices && n < MOON_GAMEPAD_FAKE_MAX_DEVICES; n++) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+      break;
+    }
+    for (int k = 0; k < 2; k++) {
+      linux_set_nonblock(fds[k], 1);
+      (void)fcntl(fds[k], F_SETFD, FD_CLOEXEC);
+    }
+    uint32_t idx = b->fds_len;
+    b->fake->wr[idx] = fds[1];
+    b->fake->len = idx + 1;
+    b->fds[idx] = fds[0];
+    b->fd_ids[idx] = b->next_id++;
+    b->rw[idx] = 1;
+    snprintf(b->paths[idx], sizeof(b->paths[idx]), "fake:%u", idx);
+    snprintf(b->names[idx], sizeof(b->names[idx]), "Fake Pad %u", idx);
+    uuid_simple_from_ids(BUS_VIRTUAL, 0, 0, (uint16_t)idx, b->uuids[idx]);
+    size_t btn_maps_len = sizeof(LINUX_BUTTON_MAPS) / sizeof(LINUX_BUTTON_MAPS[0]);
+    for (size_t i = 0; i < btn_maps_len; i++) {
+      linux_push_button_cap(b, idx, LINUX_BUTTON_MAPS[i].dst, LINUX_BUTTON_MAPS[i].src);
+    }
+    size_t axis_maps_len = sizeof(LINUX_AXIS_MAPS) / sizeof(LINUX_AXIS_MAPS[0]);
+    for (size_t i = 0; i < axis_maps_len; i++) {
+      uint16_t src = LINUX_AXIS_MAPS[i].src;
+      linux_push_axis_cap(b, idx, LINUX_AXIS_MAPS[i].dst, src);
+      if (src == ABS_HAT0X || src == ABS_HAT0Y) {
+        linux_upsert_axis_info(b, idx, LINUX_AXIS_MAPS[i].dst, -1, 1, -1);
+      } else {
+        linux_upsert_axis_info(b, idx, LINUX_AXIS_MAPS[i].dst, -32768, 32767, 0);
+      }
+    }
+    b->state_gen[idx] = ++b->state_clock;
+    linux_watch_idx(b, idx);
+    b->fds_len++;
+    b->gamepad_count = (int32_t)b->fds_len;
+  }
+}
+#endif
+
 static moon_gamepad_backend_t *backend_of(void *owner) {
   moon_gamepad_backend_owner_payload_t *p = (moon_gamepad_backend_owner_payload_t *)owner;
   if (p == NULL) {
@@ -3121,230 +6110,2247 @@ static moon_gamepad_backend_t *backend_of(void *owner) {
   return p->b;
 }
 
-void moon_gamepad_backend_poll(void *owner) {
-  moon_gamepad_backend_t *b = backend_of(owner);
+// A shared owner over `devices` pipe-backed Linux pads that is independent of
+// moon_gamepad_backend_new_shared, so tests do not see each other's state.
+// Elsewhere the owner has no backend.
+void *moon_gamepad_backend_new_fake_for_test(int32_t devices) {
+  moon_gamepad_backend_owner_payload_t *p = backend_owner_alloc(1);
+  if (p == NULL) {
+    return NULL;
+  }
+#if defined(__linux__)
+  moon_gamepad_backend_t *b = backend_create();
   if (b == NULL) {
-    return;
+    return p;
+  }
+  shared_lock();
+  if (!backend_share_locked(p, b)) {
+    free(b);
+  } else {
+    linux_fake_init(b, devices);
+  }
+  shared_unlock();
+#else
+  (void)devices;
+#endif
+  return p;
+}
+
+// Another subscriber on `owner`'s shared backend, added the way
+// moon_gamepad_backend_new_shared adds one.
+void *moon_gamepad_backend_join_for_test(void *owner) {
+  moon_gamepad_backend_owner_payload_t *src = (moon_gamepad_backend_owner_payload_t *)owner;
+  moon_gamepad_backend_owner_payload_t *p = backend_owner_alloc(1);
+  if (p == NULL || src == NULL || src->b == NULL || !src->shared) {
+    return p;
   }
+  shared_lock();
+  (void)backend_share_locked(p, src->b);
+  shared_unlock();
+  return p;
+}
+
+// Gives fake pad `idx` an FF driver with the MOON_GAMEPAD_FF_CAP_* bits in
+// `caps` and room for `effects` uploads, probed the way a scan probes one.
+int32_t moon_gamepad_backend_fake_ff_for_test(void *owner, int32_t idx, int32_t caps, int32_t effects) {
 #if defined(__linux__)
-  linux_backend_poll(b);
-#elif defined(_WIN32)
-  windows_backend_poll(b);
+  moon_gamepad_backend_t *b = backend_of(owner);
+  if (b == NULL || b->fake == NULL || idx < 0 || (uint32_t)idx >= b->fake->len) {
+    return 0;
+  }
+  linux_reader_lock(b);
+  linux_fake_ff_t *f = &b->fake->ff[idx];
+  memset(f, 0, sizeof(*f));
+  f->effects = effects < 0 ? 0 : (effects > MOON_GAMEPAD_FAKE_FF_EFFECTS ? MOON_GAMEPAD_FAKE_FF_EFFECTS : effects);
+  f->gain = 0xFFFF;
+  b->ff_caps[idx] = (uint8_t)caps;
+  b->ff_supported[idx] = (caps & MOON_GAMEPAD_FF_CAP_RUMBLE) != 0 ? 1 : 0;
+  b->ff_slots[idx] = 0;
+  if (f->effects > 1) {
+    b->ff_slots[idx] =
+        (uint8_t)(f->effects - 1 > MOON_GAMEPAD_FF_SLOT_MAX ? MOON_GAMEPAD_FF_SLOT_MAX : f->effects - 1);
+  }
+  linux_reader_unlock(b);
+  return 1;
 #else
-  (void)b;
+  (void)owner;
+  (void)idx;
+  (void)caps;
+  (void)effects;
+  return 0;
 #endif
 }
 
-void moon_gamepad_backend_poll_timeout(void *owner, int32_t timeout_ms) {
+// What fake pad `idx`'s FF driver saw: uploads, erases, plays, stops, gain
+// writes, gain, resident effects and playing effects, then the magnitude of
+// the effect in each slot (-1 when free). Empty when there is no such pad.
+moonbit_bytes_t moon_gamepad_backend_fake_ff_log_for_test(void *owner, int32_t idx) {
+#if defined(__linux__)
   moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL) {
+  if (b == NULL || b->fake == NULL || idx < 0 || (uint32_t)idx >= b->fake->len) {
+    return moonbit_make_bytes_raw(0);
+  }
+  int32_t v[8 + MOON_GAMEPAD_FAKE_FF_EFFECTS];
+  linux_reader_lock(b);
+  const linux_fake_ff_t *f = &b->fake->ff[idx];
+  int32_t n = 8 + f->effects;
+  v[0] = (int32_t)f->uploads;
+  v[1] = (int32_t)f->erases;
+  v[2] = (int32_t)f->plays;
+  v[3] = (int32_t)f->stops;
+  v[4] = (int32_t)f->gain_writes;
+  v[5] = f->gain;
+  v[6] = 0;
+  v[7] = 0;
+  for (int32_t k = 0; k < f->effects; k++) {
+    const struct ff_effect *e = &f->fx[k];
+    int32_t m = -1;
+    if (f->used[k]) {
+      v[6]++;
+      v[7] += f->playing[k] > 0 ? 1 : 0;
+      m = 0;
+      if (e->type == FF_RUMBLE) {
+        m = e->u.rumble.strong_magnitude > e->u.rumble.weak_magnitude ? e->u.rumble.strong_magnitude
+                                                                      : e->u.rumble.weak_magnitude;
+      } else if (e->type == FF_PERIODIC) {
+        m = e->u.periodic.magnitude;
+      } else if (e->type == FF_RAMP) {
+        m = abs(e->u.ramp.start_level) > abs(e->u.ramp.end_level) ? abs(e->u.ramp.start_level)
+                                                                  : abs(e->u.ramp.end_level);
+      }
+    }
+    v[8 + k] = m;
+  }
+  linux_reader_unlock(b);
+  moonbit_bytes_t out = moonbit_make_bytes_raw(n * (int32_t)sizeof(int32_t));
+  if (out == NULL) {
+    return moonbit_make_bytes_raw(0);
+  }
+  memcpy(out, v, (size_t)n * sizeof(int32_t));
+  return out;
+#else
+  (void)owner;
+  (void)idx;
+  return moonbit_make_bytes_raw(0);
+#endif
+}
+
+// Drops the fake backend's epoll set so polls take the poll() fallback.
+void moon_gamepad_backend_fake_poll_fallback_for_test(void *owner) {
+#if defined(__linux__)
+  moon_gamepad_backend_t *b = backend_of(owner);
+  if (b == NULL || b->fake == NULL) {
     return;
   }
-#if defined(__APPLE__)
-  queue_wait_nonempty(&b->q, timeout_ms);
-#elif defined(__linux__)
-  linux_backend_poll_timeout(b, timeout_ms);
+  linux_reader_lock(b);
+  if (b->epoll_fd >= 0) {
+    close(b->epoll_fd);
+    b->epoll_fd = -1;
+  }
+  linux_reader_unlock(b);
+#else
+  (void)owner;
+#endif
+}
+
+// Feeds fake pad `idx` one input event followed by a SYN_REPORT. Returns 1
+// when both were queued.
+int32_t moon_gamepad_backend_fake_input_for_test(void *owner, int32_t idx, int32_t type, int32_t code,
+                                                 int32_t value) {
+#if defined(__linux__)
+  moon_gamepad_backend_t *b = backend_of(owner);
+  if (b == NULL || b->fake == NULL || idx < 0 || (uint32_t)idx >= b->fake->len) {
+    return 0;
+  }
+  struct input_event ie[2];
+  memset(ie, 0, sizeof(ie));
+  ie[0].type = (uint16_t)type;
+  ie[0].code = (uint16_t)code;
+  ie[0].value = value;
+  ie[1].type = EV_SYN;
+  ie[1].code = SYN_REPORT;
+  return write(b->fake->wr[idx], ie, sizeof(ie)) == (ssize_t)sizeof(ie) ? 1 : 0;
+#else
+  (void)owner;
+  (void)idx;
+  (void)type;
+  (void)code;
+  (void)value;
+  return 0;
+#endif
+}
+
+#if defined(__linux__)
+static int linux_rm_tree_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+  (void)st;
+  (void)flag;
+  (void)ftw;
+  return remove(path);
+}
+
+// Appends `len` bytes of `line` plus a newline to `file`, creating parent
+// directories below `root` as needed.
+static void linux_scratch_append(const char *root, char *file, const char *line, size_t len) {
+  for (char *p = file + strlen(root) + 1; *p != '\0'; p++) {
+    if (*p == '/') {
+      *p = '\0';
+      (void)mkdir(file, 0700);
+      *p = '/';
+    }
+  }
+  FILE *fp = fopen(file, "a");
+  if (fp != NULL) {
+    fprintf(fp, "%.*s\n", (int)len, line);
+    fclose(fp);
+  }
+}
+#endif
+
+// Runs linux_filter_allows for `spec` on node `event_name` at `path` against a
+// scratch tree. Each line of `files` is `relpath=line` and appends `line` to
+// that file; sysfs lives under sys/ and the udev database under udev/.
+// Returns 1 if the node is allowed, 0 if not and -1 elsewhere.
+int32_t moon_gamepad_filter_allows_for_test(moonbit_string_t spec, moonbit_string_t event_name,
+                                            moonbit_string_t path, moonbit_string_t files) {
+#if defined(__linux__)
+  char *spec_c = moonbit_string_to_ascii_cstr(spec);
+  char *event_c = moonbit_string_to_ascii_cstr(event_name);
+  char *path_c = moonbit_string_to_ascii_cstr(path);
+  char *files_c = moonbit_string_to_ascii_cstr(files);
+  char root[] = "/tmp/moon_gamepad_filter.XXXXXX";
+  int32_t out = -1;
+  if (spec_c != NULL && event_c != NULL && path_c != NULL && files_c != NULL && mkdtemp(root) != NULL) {
+    const char *line = files_c;
+    while (line != NULL && *line != '\0') {
+      const char *end = strchr(line, '\n');
+      size_t len = end != NULL ? (size_t)(end - line) : strlen(line);
+      const char *eq = memchr(line, '=', len);
+      if (eq != NULL) {
+        char file[512];
+        snprintf(file, sizeof(file), "%s/%.*s", root, (int)(eq - line), line);
+        linux_scratch_append(root, file, eq + 1, len - (size_t)(eq - line) - 1);
+      }
+      line = end != NULL ? end + 1 : NULL;
+    }
+    linux_device_filter_t f;
+    linux_filter_parse(&f, spec_c);
+    snprintf(f.sysfs_dir, sizeof(f.sysfs_dir), "%s/sys", root);
+    snprintf(f.udev_dir, sizeof(f.udev_dir), "%s/udev", root);
+    out = linux_filter_allows(&f, event_c, path_c);
+    (void)nftw(root, linux_rm_tree_entry, 8, FTW_DEPTH | FTW_PHYS);
+  }
+  free(spec_c);
+  free(event_c);
+  free(path_c);
+  free(files_c);
+  return out;
+#else
+  (void)spec;
+  (void)event_name;
+  (void)path;
+  (void)files;
+  return -1;
+#endif
+}
+
+// Feeds `devices` pipe-backed fake pads one axis report per round and returns
+// the mean ns per round to decode everything. `mode` is 0 for epoll + read(),
+// 1 for io_uring and 2 for the low-latency reader thread. Returns -1 if the
+// requested path is unavailable and -2 if reports went missing.
+int64_t moon_gamepad_backend_bench_reads_for_test(int32_t devices, int32_t mode, int32_t rounds) {
+#if defined(__linux__)
+  if (devices <= 0 || devices > MOON_GAMEPAD_LINUX_MAX_DEVICES || rounds <= 0) {
+    return -1;
+  }
+  moon_gamepad_backend_t *b = backend_create();
+  moon_gamepad_subscriber_t *sub = subscriber_new();
+  int wr[MOON_GAMEPAD_LINUX_MAX_DEVICES];
+  int32_t opened = 0;
+  int64_t out = -1;
+  if (b == NULL || sub == NULL) {
+    free(b);
+    subscriber_free(sub);
+    return -1;
+  }
+  (void)backend_subscribe(b, sub);
+  memset(b->fds, -1, sizeof(b->fds));
+  b->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  b->hotplug_fd = -1;
+  b->ff_timer_fd = -1;
+  b->uring = NULL;
+  for (; opened < devices; opened++) {
+    int32_t i = opened;
+    int fds[2];
+    if (pipe(fds) != 0) {
+      break;
+    }
+    for (int k = 0; k < 2; k++) {
+      linux_set_nonblock(fds[k], 1);
+      (void)fcntl(fds[k], F_SETFD, FD_CLOEXEC);
+    }
+    wr[i] = fds[1];
+    b->fds[i] = fds[0];
+    b->fd_ids[i] = (uint32_t)i;
+    b->ff_id[i] = -1;
+    b->vendors[i] = -1;
+    b->products[i] = -1;
+    b->fds_len = (uint32_t)i + 1;
+    linux_watch_idx(b, (uint32_t)i);
+  }
+  devices = opened;
+  b->next_id = (uint32_t)devices;
+  b->gamepad_count = devices;
+  if (mode == 1 && !linux_uring_open(b)) {
+    goto done;
+  }
+  if (mode == 2 && linux_reader_start(b, -1, 0) == 0) {
+    goto done;
+  }
+  struct input_event report[2];
+  memset(report, 0, sizeof(report));
+  report[0].type = EV_ABS;
+  report[0].code = ABS_X;
+  report[1].type = EV_SYN;
+  report[1].code = SYN_REPORT;
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (int32_t r = 0; r < rounds; r++) {
+    report[0].value = r;
+    for (int32_t i = 0; i < devices; i++) {
+      (void)write(wr[i], report, sizeof(report));
+    }
+    int32_t seen = 0;
+    for (int spins = 0; seen < devices && spins < 1000; spins++) {
+      linux_poll_subscriber(b, sub, 100);
+      moon_gamepad_event_t ev;
+      while (subscriber_pop(b, sub, &ev)) {
+        seen++;
+      }
+    }
+    if (seen != devices) {
+      out = -2;
+      goto done;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  out = ((int64_t)(t1.tv_sec - t0.tv_sec) * 1000000000LL + (int64_t)(t1.tv_nsec - t0.tv_nsec)) / rounds;
+done:
+  for (int32_t i = 0; i < opened; i++) {
+    close(wr[i]);
+  }
+  backend_unsubscribe(b, sub);
+  backend_destroy(b);
+  subscriber_free(sub);
+  return out;
+#else
+  (void)devices;
+  (void)mode;
+  (void)rounds;
+  return -1;
+#endif
+}
+
+moonbit_string_t moon_gamepad_uuid_simple_from_ids(
+    int32_t bustype,
+    int32_t vendor,
+    int32_t product,
+    int32_t version) {
+  char out33[33];
+  uuid_simple_from_ids(
+      (uint16_t)bustype,
+      (uint16_t)vendor,
+      (uint16_t)product,
+      (uint16_t)version,
+      out33);
+  return moonbit_string_from_utf8_lossy(out33);
+}
+
+int64_t moon_gamepad_now_ms(void) {
+  if (g_now_ms_override_for_test >= 0) {
+    return g_now_ms_override_for_test;
+  }
+  return now_ms();
+}
+
+moonbit_string_t moon_gamepad_env_sdl_gamecontrollerconfig(void) {
+  return moonbit_string_from_utf8_lossy(getenv("SDL_GAMECONTROLLERCONFIG"));
+}
+
+moonbit_string_t moon_gamepad_sdl_platform_name(void) {
+#if defined(__APPLE__)
+  return moonbit_string_from_utf8_lossy("Mac OS X");
+#elif defined(__linux__)
+  return moonbit_string_from_utf8_lossy("Linux");
+#elif defined(_WIN32)
+  return moonbit_string_from_utf8_lossy("Windows");
+#else
+  return moonbit_string_from_utf8_lossy("");
+#endif
+}
+
+void moon_gamepad_set_sdl_gamecontrollerconfig_for_test(moonbit_string_t value) {
+  char *v = moonbit_string_to_ascii_cstr(value);
+  if (v == NULL) {
+    return;
+  }
+#if defined(_WIN32)
+  _putenv_s("SDL_GAMECONTROLLERCONFIG", v);
+#else
+  setenv("SDL_GAMECONTROLLERCONFIG", v, 1);
+#endif
+  free(v);
+}
+
+void moon_gamepad_clear_sdl_gamecontrollerconfig_for_test(void) {
+#if defined(_WIN32)
+  _putenv_s("SDL_GAMECONTROLLERCONFIG", "");
+#else
+  unsetenv("SDL_GAMECONTROLLERCONFIG");
+#endif
+}
+
+void moon_gamepad_now_ms_set_for_test(int64_t ms) {
+  g_now_ms_override_for_test = ms;
+}
+
+void moon_gamepad_now_ms_clear_for_test(void) {
+  g_now_ms_override_for_test = -1;
+}
+
+int32_t moon_gamepad_macos_hat_pack_for_test(int32_t hat_v, int32_t hat_min, int32_t hat_max) {
+#if defined(__APPLE__)
+  int32_t x_raw = 0;
+  int32_t y_raw = 0;
+  mac_hat_to_xy_raw(hat_v, hat_min, hat_max, &x_raw, &y_raw);
+  int32_t x_pack = (x_raw + 2) & 0x3;
+  int32_t y_pack = (y_raw + 2) & 0x3;
+  return x_pack | (y_pack << 2);
+#else
+  (void)hat_v;
+  (void)hat_min;
+  (void)hat_max;
+  return 0;
+#endif
+}
+
+static int idx_by_id_u32(const uint32_t *ids, uint32_t len, uint32_t id) {
+  for (uint32_t i = 0; i < len; i++) {
+    if (ids[i] == id) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+// -----------------------------------------------------------------------------
+// Broker: one process owns the devices and publishes into shared memory
+// -----------------------------------------------------------------------------
+
+#if defined(__linux__)
+#define MOON_GAMEPAD_SHM_MAGIC 0x4D475042u
+#define MOON_GAMEPAD_SHM_VERSION 3u
+#define MOON_GAMEPAD_SHM_DEVICES 64
+#define MOON_GAMEPAD_SHM_RING 4096
+#define MOON_GAMEPAD_SHM_CMDS 256
+// Attached clients that can rumble at once; each owns a slot in client_pids.
+#define MOON_GAMEPAD_SHM_CLIENTS 32
+// How often the broker checks that clients with an active rumble still run.
+#define MOON_GAMEPAD_SHM_SWEEP_MS 250
+// Seqlock retries before a device slot is reported absent; an odd seq that
+// never settles means the broker died mid-write.
+#define MOON_GAMEPAD_SHM_READ_SPINS 100000
+
+// State mirror for one broker id, guarded by a seqlock (odd seq = write in progress).
+typedef struct moon_gamepad_shm_device_t {
+  uint32_t seq;
+  uint32_t present;
+  uint32_t connected;
+  uint32_t ff_supported;
+  int32_t vendor;
+  int32_t product;
+  uint16_t rumble_strong;
+  uint16_t rumble_weak;
+  uint8_t axes_len;
+  uint8_t buttons_len;
+  uint8_t axis_info_len;
+  uint8_t pad;
+  char name[256];
+  char uuid[33];
+  int32_t axes_codes[32];
+  int32_t axes_value[32];
+  int32_t buttons_codes[64];
+  uint8_t buttons_pressed[64];
+  int32_t axis_info_codes[32];
+  int32_t axis_info_min[32];
+  int32_t axis_info_max[32];
+  int32_t axis_info_deadzone[32];
+} moon_gamepad_shm_device_t;
+
+// A rumble request from client slot `client`; id -1 releases the slot.
+typedef struct moon_gamepad_shm_cmd_t {
+  uint64_t stamp;
+  int32_t id;
+  int32_t duration_ms;
+  uint16_t strong;
+  uint16_t weak;
+  int32_t client;
+} moon_gamepad_shm_cmd_t;
+
+typedef struct moon_gamepad_shm_t {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t futex;
+  uint32_t device_hint;
+  // Broker process, so a segment left by a crashed broker can be detected.
+  int32_t broker_pid;
+  uint32_t reserved;
+  uint64_t write_seq;
+  moon_gamepad_shm_device_t devices[MOON_GAMEPAD_SHM_DEVICES];
+  moon_gamepad_event_t ring[MOON_GAMEPAD_SHM_RING];
+  uint64_t cmd_write;
+  uint64_t cmd_read;
+  moon_gamepad_shm_cmd_t cmds[MOON_GAMEPAD_SHM_CMDS];
+  // Process of each client slot, 0 when free.
+  int32_t client_pids[MOON_GAMEPAD_SHM_CLIENTS];
+} moon_gamepad_shm_t;
+
+struct moon_gamepad_client_t {
+  moon_gamepad_shm_t *shm;
+  uint64_t read_seq;
+  uint64_t dropped;
+  // Slot in client_pids, or -1 when every slot was taken (no rumble).
+  int32_t slot;
+};
+
+typedef struct moon_gamepad_broker_t {
+  moon_gamepad_shm_t *shm;
+  char shm_name[128];
+  moon_gamepad_backend_t *b;
+  moon_gamepad_subscriber_t *sub;
+  // Broker id -> (source, source id); source 0 = device backend, 1 = synthetic.
+  uint8_t map_src[MOON_GAMEPAD_SHM_DEVICES];
+  uint32_t map_sid[MOON_GAMEPAD_SHM_DEVICES];
+  uint32_t map_len;
+  uint32_t next_synthetic;
+  // Last rumble request of each client slot per broker id, as the shared
+  // backend keeps one per subscriber; a device plays the sum of the live
+  // ones. rumble_pid is the slot's process when the requests were made.
+  uint16_t rumble_strong[MOON_GAMEPAD_SHM_CLIENTS][MOON_GAMEPAD_SHM_DEVICES];
+  uint16_t rumble_weak[MOON_GAMEPAD_SHM_CLIENTS][MOON_GAMEPAD_SHM_DEVICES];
+  int64_t rumble_until_ms[MOON_GAMEPAD_SHM_CLIENTS][MOON_GAMEPAD_SHM_DEVICES];
+  int32_t rumble_pid[MOON_GAMEPAD_SHM_CLIENTS];
+  int64_t next_sweep_ms;
+} moon_gamepad_broker_t;
+
+static void shm_name_for(const char *name, char *out, size_t cap) {
+  snprintf(out, cap, "/moon_gamepad.%s", name);
+  for (char *p = out + 1; *p != '\0'; p++) {
+    if (*p == '/') {
+      *p = '_';
+    }
+  }
+}
+
+static void shm_futex_wake(moon_gamepad_shm_t *shm) {
+  __atomic_add_fetch(&shm->futex, 1, __ATOMIC_RELEASE);
+  (void)syscall(SYS_futex, &shm->futex, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+static void shm_device_begin(moon_gamepad_shm_device_t *d) {
+  __atomic_add_fetch(&d->seq, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void shm_device_end(moon_gamepad_shm_device_t *d) {
+  __atomic_add_fetch(&d->seq, 1, __ATOMIC_RELEASE);
+}
+
+// Returns 0, with `out` zeroed (not present), if the slot never settles.
+static int shm_device_read(moon_gamepad_shm_t *shm, uint32_t id, moon_gamepad_shm_device_t *out) {
+  moon_gamepad_shm_device_t *d = &shm->devices[id];
+  for (uint32_t spins = 0; spins < MOON_GAMEPAD_SHM_READ_SPINS; spins++) {
+    uint32_t s1 = __atomic_load_n(&d->seq, __ATOMIC_ACQUIRE);
+    if ((s1 & 1u) != 0) {
+      continue;
+    }
+    memcpy(out, d, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&d->seq, __ATOMIC_RELAXED) == s1) {
+      return 1;
+    }
+  }
+  memset(out, 0, sizeof(*out));
+  return 0;
+}
+
+static void shm_publish(moon_gamepad_shm_t *shm, moon_gamepad_event_t ev) {
+  uint64_t seq = __atomic_load_n(&shm->write_seq, __ATOMIC_RELAXED);
+  shm->ring[seq % MOON_GAMEPAD_SHM_RING] = ev;
+  __atomic_store_n(&shm->write_seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+static int client_pop(moon_gamepad_client_t *c, moon_gamepad_event_t *out) {
+  while (1) {
+    uint64_t w = __atomic_load_n(&c->shm->write_seq, __ATOMIC_ACQUIRE);
+    if (c->read_seq >= w) {
+      return 0;
+    }
+    // The slot of read_seq is rewritten while the broker publishes
+    // read_seq + RING, i.e. as soon as write_seq reaches it.
+    if (w - c->read_seq >= MOON_GAMEPAD_SHM_RING) {
+      c->dropped += w - c->read_seq - (MOON_GAMEPAD_SHM_RING - 1);
+      c->read_seq = w - (MOON_GAMEPAD_SHM_RING - 1);
+    }
+    *out = c->shm->ring[c->read_seq % MOON_GAMEPAD_SHM_RING];
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t w2 = __atomic_load_n(&c->shm->write_seq, __ATOMIC_RELAXED);
+    if (w2 - c->read_seq >= MOON_GAMEPAD_SHM_RING) {
+      // Overwritten while copying; resynchronize.
+      continue;
+    }
+    c->read_seq++;
+    return 1;
+  }
+}
+
+static void client_wait(moon_gamepad_client_t *c, int32_t timeout_ms) {
+  uint32_t f = __atomic_load_n(&c->shm->futex, __ATOMIC_ACQUIRE);
+  if (timeout_ms == 0 || __atomic_load_n(&c->shm->write_seq, __ATOMIC_ACQUIRE) > c->read_seq) {
+    return;
+  }
+  struct timespec ts;
+  ts.tv_sec = (time_t)(timeout_ms / 1000);
+  ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+  (void)syscall(SYS_futex, &c->shm->futex, FUTEX_WAIT, f, (timeout_ms < 0) ? NULL : &ts, NULL, 0);
+}
+
+static void client_post(moon_gamepad_client_t *c, int32_t id, uint16_t strong, uint16_t weak, int32_t duration_ms) {
+  uint64_t n = __atomic_fetch_add(&c->shm->cmd_write, 1, __ATOMIC_ACQ_REL);
+  moon_gamepad_shm_cmd_t *cmd = &c->shm->cmds[n % MOON_GAMEPAD_SHM_CMDS];
+  cmd->id = id;
+  cmd->strong = strong;
+  cmd->weak = weak;
+  cmd->duration_ms = duration_ms;
+  cmd->client = c->slot;
+  __atomic_store_n(&cmd->stamp, n + 1, __ATOMIC_RELEASE);
+  shm_futex_wake(c->shm);
+}
+
+static int client_send_rumble(moon_gamepad_client_t *c, int32_t id, uint16_t strong, uint16_t weak,
+                              int32_t duration_ms) {
+  if (c->slot < 0 || id < 0 || id >= MOON_GAMEPAD_SHM_DEVICES) {
+    return 0;
+  }
+  moon_gamepad_shm_device_t d;
+  shm_device_read(c->shm, (uint32_t)id, &d);
+  if (!d.present || !d.connected || !d.ff_supported) {
+    return 0;
+  }
+  client_post(c, id, strong, weak, duration_ms);
+  return 1;
+}
+
+static int shm_pid_alive(int32_t pid) {
+  return pid > 0 && (kill((pid_t)pid, 0) == 0 || errno != ESRCH);
+}
+
+// True for a segment whose broker is gone: it died without Broker::close, or
+// before the segment was initialized. A live broker of another layout
+// version keeps its name.
+static int shm_is_stale(const char *shm_name) {
+  int fd = shm_open(shm_name, O_RDONLY, 0);
+  if (fd < 0) {
+    return 0;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return 0;
+  }
+  if ((size_t)st.st_size < sizeof(moon_gamepad_shm_t)) {
+    close(fd);
+    return 1;
+  }
+  void *m = mmap(NULL, sizeof(moon_gamepad_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (m == MAP_FAILED) {
+    return 0;
+  }
+  const moon_gamepad_shm_t *shm = (const moon_gamepad_shm_t *)m;
+  int stale = (shm->version == MOON_GAMEPAD_SHM_VERSION) ? !shm_pid_alive(shm->broker_pid)
+                                                         : (shm->magic != MOON_GAMEPAD_SHM_MAGIC);
+  munmap(m, sizeof(moon_gamepad_shm_t));
+  return stale;
+}
+
+static moon_gamepad_shm_t *shm_map(const char *shm_name, int create) {
+  int flags = create ? (O_CREAT | O_EXCL | O_RDWR) : O_RDWR;
+  int fd = shm_open(shm_name, flags, 0660);
+  if (fd < 0 && create && errno == EEXIST && shm_is_stale(shm_name)) {
+    // Take the name over from a crashed broker.
+    shm_unlink(shm_name);
+    fd = shm_open(shm_name, flags, 0660);
+  }
+  if (fd < 0) {
+    return NULL;
+  }
+  if (create && ftruncate(fd, (off_t)sizeof(moon_gamepad_shm_t)) != 0) {
+    close(fd);
+    shm_unlink(shm_name);
+    return NULL;
+  }
+  void *m = mmap(NULL, sizeof(moon_gamepad_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (m == MAP_FAILED) {
+    if (create) {
+      shm_unlink(shm_name);
+    }
+    return NULL;
+  }
+  moon_gamepad_shm_t *shm = (moon_gamepad_shm_t *)m;
+  if (!create && (shm->magic != MOON_GAMEPAD_SHM_MAGIC || shm->version != MOON_GAMEPAD_SHM_VERSION ||
+                  !shm_pid_alive(shm->broker_pid))) {
+    munmap(m, sizeof(moon_gamepad_shm_t));
+    return NULL;
+  }
+  return shm;
+}
+
+// Clears a broker id's mirror and rumble shares for a new device. The seq
+// (first field) is kept so readers see the rewrite.
+static void broker_id_reset(moon_gamepad_broker_t *br, uint32_t id) {
+  moon_gamepad_shm_device_t *d = &br->shm->devices[id];
+  shm_device_begin(d);
+  memset((char *)d + sizeof(d->seq), 0, sizeof(*d) - sizeof(d->seq));
+  shm_device_end(d);
+  for (uint32_t k = 0; k < MOON_GAMEPAD_SHM_CLIENTS; k++) {
+    br->rumble_strong[k][id] = 0;
+    br->rumble_weak[k][id] = 0;
+    br->rumble_until_ms[k][id] = 0;
+  }
+}
+
+// Broker ids are handed out in order. Once all are taken, the id of a
+// disconnected device is reused (clients see it connect as the new device);
+// with every device connected, new ones are left out (-1).
+static int broker_id_for(moon_gamepad_broker_t *br, uint8_t src, uint32_t sid, int create) {
+  for (uint32_t i = 0; i < br->map_len; i++) {
+    if (br->map_src[i] == src && br->map_sid[i] == sid) {
+      return (int)i;
+    }
+  }
+  if (!create) {
+    return -1;
+  }
+  uint32_t id = br->map_len;
+  if (id < MOON_GAMEPAD_SHM_DEVICES) {
+    br->map_len++;
+    __atomic_store_n(&br->shm->device_hint, br->map_len, __ATOMIC_RELEASE);
+  } else {
+    for (id = 0; id < br->map_len && br->shm->devices[id].connected; id++) {
+    }
+    if (id == br->map_len) {
+      return -1;
+    }
+    broker_id_reset(br, id);
+  }
+  br->map_src[id] = src;
+  br->map_sid[id] = sid;
+  return (int)id;
+}
+
+static void broker_mirror_from_backend(moon_gamepad_broker_t *br, uint32_t id, uint32_t sid) {
+  moon_gamepad_backend_t *b = br->b;
+  moon_gamepad_shm_device_t *d = &br->shm->devices[id];
+  int idx = -1;
+  for (uint32_t i = 0; i < b->fds_len; i++) {
+    if (b->fd_ids[i] == sid && b->fds[i] >= 0) {
+      idx = (int)i;
+      break;
+    }
+  }
+  shm_device_begin(d);
+  d->present = 1;
+  d->connected = (idx >= 0) ? 1u : 0u;
+  if (idx >= 0) {
+    uint32_t i = (uint32_t)idx;
+    d->ff_supported = b->ff_supported[i];
+    d->vendor = b->vendors[i];
+    d->product = b->products[i];
+    memcpy(d->name, b->names[i], sizeof(d->name));
+    memcpy(d->uuid, b->uuids[i], sizeof(d->uuid));
+    d->axes_len = b->axes_len[i];
+    memcpy(d->axes_codes, b->axes_codes[i], sizeof(d->axes_codes));
+    memcpy(d->axes_value, b->axes_value[i], sizeof(d->axes_value));
+    d->buttons_len = b->buttons_len[i];
+    memcpy(d->buttons_codes, b->buttons_codes[i], sizeof(d->buttons_codes));
+    memcpy(d->buttons_pressed, b->buttons_pressed[i], sizeof(d->buttons_pressed));
+    d->axis_info_len = b->axis_info_len[i];
+    memcpy(d->axis_info_codes, b->axis_info_codes[i], sizeof(d->axis_info_codes));
+    memcpy(d->axis_info_min, b->axis_info_min[i], sizeof(d->axis_info_min));
+    memcpy(d->axis_info_max, b->axis_info_max[i], sizeof(d->axis_info_max));
+    memcpy(d->axis_info_deadzone, b->axis_info_deadzone[i], sizeof(d->axis_info_deadzone));
+  }
+  shm_device_end(d);
+}
+
+// Applies an input event to the mirror of a broker id (synthetic devices and value updates).
+static void broker_mirror_apply(moon_gamepad_broker_t *br, uint32_t id, const moon_gamepad_event_t *ev) {
+  moon_gamepad_shm_device_t *d = &br->shm->devices[id];
+  shm_device_begin(d);
+  if (ev->tag == MOON_GAMEPAD_EV_CONNECTED) {
+    d->connected = 1;
+  } else if (ev->tag == MOON_GAMEPAD_EV_DISCONNECTED) {
+    d->connected = 0;
+  } else if (ev->tag == MOON_GAMEPAD_EV_AXIS_CHANGED) {
+    uint8_t i = 0;
+    while (i < d->axes_len && d->axes_codes[i] != (int32_t)ev->code) {
+      i++;
+    }
+    if (i == d->axes_len && i < 32) {
+      // Synthetic devices learn their capabilities from the events they emit.
+      d->axes_codes[d->axes_len++] = (int32_t)ev->code;
+    }
+    if (i < d->axes_len) {
+      d->axes_value[i] = (int32_t)ev->value;
+    }
+  } else if (ev->tag == MOON_GAMEPAD_EV_BUTTON_PRESSED || ev->tag == MOON_GAMEPAD_EV_BUTTON_RELEASED) {
+    uint8_t i = 0;
+    while (i < d->buttons_len && d->buttons_codes[i] != (int32_t)ev->code) {
+      i++;
+    }
+    if (i == d->buttons_len && i < 64) {
+      d->buttons_codes[d->buttons_len++] = (int32_t)ev->code;
+    }
+    if (i < d->buttons_len) {
+      d->buttons_pressed[i] = (ev->tag == MOON_GAMEPAD_EV_BUTTON_PRESSED) ? 1 : 0;
+    }
+  }
+  shm_device_end(d);
+}
+
+// Sends broker id `id` the sum of the client shares still running at `t`,
+// as backend_rumble_mix does for subscribers of a shared backend.
+static void broker_rumble_remix(moon_gamepad_broker_t *br, uint32_t id, int64_t t) {
+  uint32_t sum_s = 0;
+  uint32_t sum_w = 0;
+  int64_t max_until = 0;
+  for (uint32_t k = 0; k < MOON_GAMEPAD_SHM_CLIENTS; k++) {
+    if (br->rumble_until_ms[k][id] <= t) {
+      continue;
+    }
+    sum_s += br->rumble_strong[k][id];
+    sum_w += br->rumble_weak[k][id];
+    if (br->rumble_until_ms[k][id] > max_until) {
+      max_until = br->rumble_until_ms[k][id];
+    }
+  }
+  int32_t duration_ms = (max_until > t) ? (int32_t)(max_until - t) : 0;
+  uint16_t s = duration_ms > 0 ? (uint16_t)(sum_s > 0xFFFFu ? 0xFFFFu : sum_s) : 0;
+  uint16_t w = duration_ms > 0 ? (uint16_t)(sum_w > 0xFFFFu ? 0xFFFFu : sum_w) : 0;
+  moon_gamepad_shm_device_t *d = &br->shm->devices[id];
+  shm_device_begin(d);
+  d->rumble_strong = s;
+  d->rumble_weak = w;
+  shm_device_end(d);
+  if (br->map_src[id] == 0 && br->b != NULL) {
+    int idx = idx_by_id_u32(br->b->fd_ids, br->b->fds_len, br->map_sid[id]);
+    if (idx >= 0) {
+      (void)linux_ff_set_rumble_idx(br->b, (uint32_t)idx, s, w, duration_ms);
+    }
+  }
+}
+
+// Drops client slot `k`'s shares and remixes the devices it was driving.
+static void broker_rumble_release(moon_gamepad_broker_t *br, uint32_t k, int64_t t) {
+  for (uint32_t id = 0; id < br->map_len; id++) {
+    if (br->rumble_until_ms[k][id] == 0) {
+      continue;
+    }
+    br->rumble_strong[k][id] = 0;
+    br->rumble_weak[k][id] = 0;
+    br->rumble_until_ms[k][id] = 0;
+    broker_rumble_remix(br, id, t);
+  }
+  br->rumble_pid[k] = 0;
+}
+
+// Removes the shares of clients that went away without releasing their slot
+// (a crash, or a slot taken over from a dead process), and of requests whose
+// window ended, so the others' mix no longer carries them.
+static void broker_rumble_sweep(moon_gamepad_broker_t *br) {
+  int64_t t = now_ms();
+  int check_pids = t >= br->next_sweep_ms;
+  if (check_pids) {
+    br->next_sweep_ms = t + MOON_GAMEPAD_SHM_SWEEP_MS;
+  }
+  for (uint32_t k = 0; k < MOON_GAMEPAD_SHM_CLIENTS; k++) {
+    if (br->rumble_pid[k] == 0) {
+      continue;
+    }
+    int32_t pid = __atomic_load_n(&br->shm->client_pids[k], __ATOMIC_ACQUIRE);
+    if (pid != br->rumble_pid[k] || (check_pids && !shm_pid_alive(pid))) {
+      broker_rumble_release(br, k, t);
+      continue;
+    }
+    for (uint32_t id = 0; id < br->map_len; id++) {
+      if (br->rumble_until_ms[k][id] != 0 && br->rumble_until_ms[k][id] <= t) {
+        br->rumble_strong[k][id] = 0;
+        br->rumble_weak[k][id] = 0;
+        br->rumble_until_ms[k][id] = 0;
+        broker_rumble_remix(br, id, t);
+      }
+    }
+  }
+}
+
+static void broker_apply_commands(moon_gamepad_broker_t *br) {
+  moon_gamepad_shm_t *shm = br->shm;
+  broker_rumble_sweep(br);
+  uint64_t w = __atomic_load_n(&shm->cmd_write, __ATOMIC_ACQUIRE);
+  if (w - shm->cmd_read > MOON_GAMEPAD_SHM_CMDS) {
+    shm->cmd_read = w - MOON_GAMEPAD_SHM_CMDS;
+  }
+  while (shm->cmd_read < w) {
+    moon_gamepad_shm_cmd_t *cmd = &shm->cmds[shm->cmd_read % MOON_GAMEPAD_SHM_CMDS];
+    if (__atomic_load_n(&cmd->stamp, __ATOMIC_ACQUIRE) != shm->cmd_read + 1) {
+      break;
+    }
+    int32_t id = cmd->id;
+    int32_t k = cmd->client;
+    int64_t t = now_ms();
+    if (k >= 0 && k < MOON_GAMEPAD_SHM_CLIENTS && id == -1) {
+      broker_rumble_release(br, (uint32_t)k, t);
+    } else if (k >= 0 && k < MOON_GAMEPAD_SHM_CLIENTS && id >= 0 && (uint32_t)id < br->map_len) {
+      int stop = cmd->duration_ms <= 0;
+      br->rumble_pid[k] = __atomic_load_n(&shm->client_pids[k], __ATOMIC_ACQUIRE);
+      br->rumble_strong[k][id] = stop ? 0 : cmd->strong;
+      br->rumble_weak[k][id] = stop ? 0 : cmd->weak;
+      br->rumble_until_ms[k][id] = stop ? 0 : t + (int64_t)cmd->duration_ms;
+      broker_rumble_remix(br, (uint32_t)id, t);
+    }
+    shm->cmd_read++;
+  }
+}
+
+static int32_t broker_pump(moon_gamepad_broker_t *br, int32_t timeout_ms) {
+  int32_t n = 0;
+  broker_apply_commands(br);
+  if (br->b == NULL && timeout_ms != 0) {
+    // Synthetic-only broker: sleep until a client posts a command.
+    uint32_t f = __atomic_load_n(&br->shm->futex, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&br->shm->cmd_write, __ATOMIC_ACQUIRE) == br->shm->cmd_read) {
+      struct timespec ts;
+      ts.tv_sec = (time_t)(timeout_ms / 1000);
+      ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+      (void)syscall(SYS_futex, &br->shm->futex, FUTEX_WAIT, f, (timeout_ms < 0) ? NULL : &ts, NULL, 0);
+    }
+  }
+  if (br->b != NULL) {
+    linux_backend_poll_timeout(br->b, timeout_ms);
+    moon_gamepad_event_t ev;
+    while (subscriber_pop(br->b, br->sub, &ev)) {
+      int id = broker_id_for(br, 0, ev.id, ev.tag == MOON_GAMEPAD_EV_CONNECTED);
+      if (id < 0) {
+        continue;
+      }
+      if (ev.tag == MOON_GAMEPAD_EV_CONNECTED || ev.tag == MOON_GAMEPAD_EV_DISCONNECTED) {
+        broker_mirror_from_backend(br, (uint32_t)id, ev.id);
+      } else {
+        broker_mirror_apply(br, (uint32_t)id, &ev);
+      }
+      ev.id = (uint32_t)id;
+      shm_publish(br->shm, ev);
+      n++;
+    }
+  }
+  if (n > 0) {
+    shm_futex_wake(br->shm);
+  }
+  broker_apply_commands(br);
+  return n;
+}
+static int32_t broker_emit(moon_gamepad_broker_t *br, uint32_t id, moon_gamepad_event_t ev) {
+  broker_mirror_apply(br, id, &ev);
+  ev.id = id;
+  shm_publish(br->shm, ev);
+  shm_futex_wake(br->shm);
+  return 1;
+}
+
+static int32_t broker_add_synthetic(moon_gamepad_broker_t *br, const char *name, int ff_supported) {
+  int id = broker_id_for(br, 1, br->next_synthetic, 1);
+  if (id < 0) {
+    return -1;
+  }
+  moon_gamepad_shm_device_t *d = &br->shm->devices[id];
+  shm_device_begin(d);
+  d->present = 1;
+  d->ff_supported = ff_supported ? 1u : 0u;
+  d->vendor = -1;
+  d->product = -1;
+  strncpy(d->name, name, sizeof(d->name) - 1);
+  uuid_simple_from_ids(BUS_VIRTUAL, 0, 0, (uint16_t)br->next_synthetic, d->uuid);
+  shm_device_end(d);
+  br->next_synthetic++;
+  moon_gamepad_event_t ev = {MOON_GAMEPAD_EV_CONNECTED, (uint32_t)id, 0, 0, 0.0, now_ms()};
+  (void)broker_emit(br, (uint32_t)id, ev);
+  return id;
+}
+
+static void broker_free(moon_gamepad_broker_t *br) {
+  if (br == NULL) {
+    return;
+  }
+  if (br->b != NULL) {
+    backend_unsubscribe(br->b, br->sub);
+    backend_destroy(br->b);
+  }
+  subscriber_free(br->sub);
+  if (br->shm != NULL) {
+    munmap(br->shm, sizeof(moon_gamepad_shm_t));
+    shm_unlink(br->shm_name);
+  }
+  free(br);
+}
+
+static moon_gamepad_broker_t *broker_open(const char *name, int open_devices) {
+  moon_gamepad_broker_t *br = (moon_gamepad_broker_t *)calloc(1, sizeof(moon_gamepad_broker_t));
+  if (br == NULL) {
+    return NULL;
+  }
+  shm_name_for(name, br->shm_name, sizeof(br->shm_name));
+  br->shm = shm_map(br->shm_name, 1);
+  if (br->shm == NULL) {
+    free(br);
+    return NULL;
+  }
+  memset(br->shm, 0, sizeof(moon_gamepad_shm_t));
+  br->shm->version = MOON_GAMEPAD_SHM_VERSION;
+  br->shm->broker_pid = (int32_t)getpid();
+  if (open_devices) {
+    br->b = backend_create();
+    br->sub = subscriber_new();
+    if (br->b == NULL || br->sub == NULL) {
+      free(br->b);
+      br->b = NULL;
+      broker_free(br);
+      return NULL;
+    }
+    (void)backend_subscribe(br->b, br->sub);
+    backend_start(br->b);
+    for (uint32_t i = 0; i < br->b->fds_len; i++) {
+      int id = broker_id_for(br, 0, br->b->fd_ids[i], 1);
+      if (id >= 0) {
+        broker_mirror_from_backend(br, (uint32_t)id, br->b->fd_ids[i]);
+      }
+    }
+  }
+  __atomic_store_n(&br->shm->magic, MOON_GAMEPAD_SHM_MAGIC, __ATOMIC_RELEASE);
+  return br;
+}
+
+// A free client slot, else one whose process has exited; -1 when none.
+static int32_t client_claim_slot(moon_gamepad_shm_t *shm) {
+  int32_t pid = (int32_t)getpid();
+  for (int32_t k = 0; k < MOON_GAMEPAD_SHM_CLIENTS; k++) {
+    int32_t cur = 0;
+    if (__atomic_compare_exchange_n(&shm->client_pids[k], &cur, pid, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return k;
+    }
+  }
+  for (int32_t k = 0; k < MOON_GAMEPAD_SHM_CLIENTS; k++) {
+    int32_t cur = __atomic_load_n(&shm->client_pids[k], __ATOMIC_ACQUIRE);
+    if (cur != 0 && !shm_pid_alive(cur) &&
+        __atomic_compare_exchange_n(&shm->client_pids[k], &cur, pid, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return k;
+    }
+  }
+  return -1;
+}
+
+static moon_gamepad_client_t *client_attach(const char *name) {
+  char shm_name[128];
+  shm_name_for(name, shm_name, sizeof(shm_name));
+  moon_gamepad_shm_t *shm = shm_map(shm_name, 0);
+  if (shm == NULL) {
+    return NULL;
+  }
+  moon_gamepad_client_t *c = (moon_gamepad_client_t *)calloc(1, sizeof(moon_gamepad_client_t));
+  if (c == NULL) {
+    munmap(shm, sizeof(moon_gamepad_shm_t));
+    return NULL;
+  }
+  c->shm = shm;
+  c->read_seq = __atomic_load_n(&shm->write_seq, __ATOMIC_ACQUIRE);
+  c->slot = client_claim_slot(shm);
+  return c;
+}
+
+// Releases the client's rumble shares before its slot, so the broker handles
+// the release ahead of any request from the slot's next owner.
+static void client_detach(moon_gamepad_client_t *c) {
+  if (c == NULL) {
+    return;
+  }
+  if (c->slot >= 0) {
+    client_post(c, -1, 0, 0, 0);
+    __atomic_store_n(&c->shm->client_pids[c->slot], 0, __ATOMIC_RELEASE);
+  }
+  munmap(c->shm, sizeof(moon_gamepad_shm_t));
+  free(c);
+}
+
+static int client_device(moon_gamepad_client_t *c, int32_t id, moon_gamepad_shm_device_t *out) {
+  if (id < 0 || id >= MOON_GAMEPAD_SHM_DEVICES) {
+    return 0;
+  }
+  shm_device_read(c->shm, (uint32_t)id, out);
+  return out->present && out->connected;
+}
+
+static int32_t client_gamepad_count(moon_gamepad_client_t *c) {
+  uint32_t hint = __atomic_load_n(&c->shm->device_hint, __ATOMIC_ACQUIRE);
+  int32_t n = 0;
+  moon_gamepad_shm_device_t d;
+  for (uint32_t i = 0; i < hint; i++) {
+    n += client_device(c, (int32_t)i, &d);
+  }
+  return n;
+}
+#endif
+
+#if defined(__linux__)
+static moon_gamepad_client_t *client_of(void *owner) {
+  moon_gamepad_backend_owner_payload_t *p = (moon_gamepad_backend_owner_payload_t *)owner;
+  if (p == NULL) {
+    return NULL;
+  }
+  return p->client;
+}
+
+static moonbit_bytes_t bytes_from_i32s(const int32_t *v, uint32_t n) {
+  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)n * 4);
+  if (out == NULL) {
+    return moonbit_make_bytes_raw(0);
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    memcpy(out + (int32_t)i * 4, &v[i], 4);
+  }
+  return out;
+}
+#endif
+
+static moon_gamepad_subscriber_t *subscriber_of(void *owner) {
+  moon_gamepad_backend_owner_payload_t *p = (moon_gamepad_backend_owner_payload_t *)owner;
+  if (p == NULL || p->b == NULL) {
+    return NULL;
+  }
+  return p->sub;
+}
+
+void moon_gamepad_backend_poll(void *owner) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    return;
+  }
+#endif
+  if (b == NULL) {
+    return;
+  }
+#if defined(__linux__)
+  linux_backend_poll(b);
+#elif defined(_WIN32)
+  windows_backend_poll(b);
+#else
+  (void)b;
+#endif
+}
+
+void moon_gamepad_backend_poll_timeout(void *owner, int32_t timeout_ms) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    client_wait(c, timeout_ms);
+    return;
+  }
+#endif
+  moon_gamepad_subscriber_t *sub = subscriber_of(owner);
+  if (b == NULL || sub == NULL) {
+    return;
+  }
+#if defined(__APPLE__)
+  queue_wait_nonempty(&sub->q, timeout_ms);
+#elif defined(__linux__)
+  linux_poll_subscriber(b, sub, timeout_ms);
+#elif defined(_WIN32)
+  windows_backend_poll_timeout(b, &sub->q, timeout_ms);
+#else
+  (void)b;
+  (void)timeout_ms;
+#endif
+}
+
+// Descriptor that polls readable when this owner has events pending. Returns
+// -1 when there is none (Windows, other targets, a backend that failed to
+// start); callers must then fall back to timed polling. Broker clients also
+// return -1: they block in poll_timeout on a futex in the shared segment.
+int32_t moon_gamepad_backend_readiness_fd(void *owner) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    return -1;
+  }
+#endif
+  moon_gamepad_subscriber_t *sub = subscriber_of(owner);
+  if (b == NULL || sub == NULL) {
+    return -1;
+  }
+  return (int32_t)subscriber_ready_fd(b, sub);
+}
+
+// Whether the async backend is still probing devices in the background.
+int32_t moon_gamepad_backend_is_probing(void *owner) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  if (client_of(owner) == NULL && b != NULL) {
+    return b->probe != NULL ? 1 : 0;
+  }
+#else
+  (void)b;
+#endif
+  return 0;
+}
+
+// Switches Linux device reads to io_uring (1) or back to epoll + read() (0).
+// Returns whether the io_uring path is active afterwards.
+int32_t moon_gamepad_backend_set_io_uring(void *owner, int32_t enabled) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  if (client_of(owner) != NULL || b == NULL) {
+    return 0;
+  }
+  if (enabled) {
+    return linux_uring_open(b);
+  }
+  linux_uring_close(b);
+  return 0;
+#else
+  (void)b;
+  (void)enabled;
+  return 0;
+#endif
+}
+
+// Starts (enabled = 1) or stops the Linux low-latency reader thread, pinned to
+// `cpu` when non-negative. Returns READER_* status flags; 0 when not running.
+int32_t moon_gamepad_backend_set_low_latency(void *owner, int32_t enabled, int32_t cpu,
+                                             int32_t realtime) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  if (client_of(owner) != NULL || b == NULL) {
+    return 0;
+  }
+  if (enabled) {
+    return linux_reader_start(b, cpu, realtime);
+  }
+  linux_reader_stop(b);
+  return 0;
+#else
+  (void)b;
+  (void)enabled;
+  (void)cpu;
+  (void)realtime;
+  return 0;
+#endif
+}
+
+// Event latency histogram as MOON_GAMEPAD_LATENCY_BUCKETS int32 counts in
+// host order; empty where kernel timestamps are unavailable.
+moonbit_bytes_t moon_gamepad_backend_latency_histogram_bin(void *owner, int32_t reset) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  if (client_of(owner) == NULL && b != NULL) {
+    int32_t counts[MOON_GAMEPAD_LATENCY_BUCKETS];
+    for (int32_t k = 0; k < MOON_GAMEPAD_LATENCY_BUCKETS; k++) {
+      uint32_t v = reset ? __atomic_exchange_n(&b->latency_hist[k], 0u, __ATOMIC_RELAXED)
+                         : __atomic_load_n(&b->latency_hist[k], __ATOMIC_RELAXED);
+      counts[k] = (int32_t)v;
+    }
+    moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)sizeof(counts));
+    if (out == NULL) {
+      return moonbit_make_bytes_raw(0);
+    }
+    memcpy(out, counts, sizeof(counts));
+    return out;
+  }
+#else
+  (void)b;
+#endif
+  (void)reset;
+  return moonbit_make_bytes_raw(0);
+}
+
+// Force-feedback syscall counters as seven int32 values in host order:
+// uploads, plays, stops, refreshes, skipped, offloads, evictions. Empty where
+// not tracked.
+moonbit_bytes_t moon_gamepad_backend_ff_stats_bin(void *owner) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  if (client_of(owner) == NULL && b != NULL) {
+    linux_reader_lock(b);
+    int32_t v[7] = {(int32_t)b->ff_stats.uploads, (int32_t)b->ff_stats.plays, (int32_t)b->ff_stats.stops,
+                    (int32_t)b->ff_stats.refreshes, (int32_t)b->ff_stats.skipped,
+                    (int32_t)b->ff_stats.offloads, (int32_t)b->ff_stats.evictions};
+    linux_reader_unlock(b);
+    moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)sizeof(v));
+    if (out == NULL) {
+      return moonbit_make_bytes_raw(0);
+    }
+    memcpy(out, v, sizeof(v));
+    return out;
+  }
+#else
+  (void)b;
+#endif
+  return moonbit_make_bytes_raw(0);
+}
+
+#if defined(__linux__)
+// One state_bin record: id, seq, button count, axis count, two words of
+// pressed-button bits and the raw axis values. Returns the next record.
+static int32_t *state_put_device(int32_t *w, uint32_t id, uint32_t seq, const uint8_t *pressed,
+                                 uint8_t buttons_len, const int32_t *axes, uint8_t axes_len) {
+  uint32_t bits[2] = {0, 0};
+  for (uint8_t k = 0; k < buttons_len && k < 64; k++) {
+    if (pressed[k]) {
+      bits[k >> 5] |= 1u << (k & 31);
+    }
+  }
+  w[0] = (int32_t)id;
+  w[1] = (int32_t)seq;
+  w[2] = (int32_t)buttons_len;
+  w[3] = (int32_t)axes_len;
+  w[4] = (int32_t)bits[0];
+  w[5] = (int32_t)bits[1];
+  memcpy(w + 6, axes, (size_t)axes_len * sizeof(int32_t));
+  return w + 6 + axes_len;
+}
+
+static moonbit_bytes_t linux_state_bin(moon_gamepad_backend_t *b) {
+  // Slots and their layouts only change on this thread; the values may be
+  // written by the reader thread, so they are copied under the seqlock.
+  uint32_t words = 1;
+  for (uint32_t i = 0; i < b->fds_len; i++) {
+    if (b->fds[i] >= 0) {
+      words += 6u + b->axes_len[i];
+    }
+  }
+  int32_t *buf = (int32_t *)malloc((size_t)words * sizeof(int32_t));
+  if (buf == NULL) {
+    return moonbit_make_bytes_raw(0);
+  }
+  // A retry means the reader thread is mid-write; back off as it does when
+  // idle, so a descheduled writer is not starved by this loop.
+  for (uint32_t spins = 0;; linux_reader_backoff(spins++)) {
+    uint32_t s1 = __atomic_load_n(&b->state_seq, __ATOMIC_ACQUIRE);
+    if ((s1 & 1u) != 0) {
+      continue;
+    }
+    int32_t *w = buf + 1;
+    int32_t count = 0;
+    for (uint32_t i = 0; i < b->fds_len; i++) {
+      if (b->fds[i] < 0) {
+        continue;
+      }
+      w = state_put_device(w, b->fd_ids[i], b->state_gen[i], b->buttons_pressed[i], b->buttons_len[i],
+                           b->axes_value[i], b->axes_len[i]);
+      count++;
+    }
+    buf[0] = count;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&b->state_seq, __ATOMIC_RELAXED) == s1) {
+      break;
+    }
+  }
+  moonbit_bytes_t out = bytes_from_i32s(buf, words);
+  free(buf);
+  return out;
+}
+
+static moonbit_bytes_t client_state_bin(moon_gamepad_client_t *c) {
+  uint32_t hint = __atomic_load_n(&c->shm->device_hint, __ATOMIC_ACQUIRE);
+  if (hint > MOON_GAMEPAD_SHM_DEVICES) {
+    hint = MOON_GAMEPAD_SHM_DEVICES;
+  }
+  int32_t buf[1 + MOON_GAMEPAD_SHM_DEVICES * (6 + 32)];
+  int32_t *w = buf + 1;
+  int32_t count = 0;
+  moon_gamepad_shm_device_t d;
+  for (uint32_t i = 0; i < hint; i++) {
+    if (!client_device(c, (int32_t)i, &d)) {
+      continue;
+    }
+    w = state_put_device(w, i, d.seq, d.buttons_pressed, d.buttons_len, d.axes_value, d.axes_len);
+    count++;
+  }
+  buf[0] = count;
+  return bytes_from_i32s(buf, (uint32_t)(w - buf));
+}
+#endif
+
+// Input state of every connected device in one call, as host-order int32:
+// the device count, then per device its id, a seq that changes whenever the
+// device's state does, the button and axis counts, two words of pressed
+// bits (buttons_bin order) and the raw axis values (axes_bin order). Empty
+// where the backend keeps no raw state. Without a reader thread nothing else
+// drains the device fds, so pending input is decoded first, without blocking.
+// The snapshot supersedes the caller's queued events, which are discarded:
+// otherwise a loop that only samples would queue without bound, and a later
+// next_event would replay presses the snapshot already applied.
+moonbit_bytes_t moon_gamepad_backend_state_bin(void *owner) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    moonbit_bytes_t out = client_state_bin(c);
+    c->read_seq = __atomic_load_n(&c->shm->write_seq, __ATOMIC_ACQUIRE);
+    return out;
+  }
+  moon_gamepad_subscriber_t *sub = subscriber_of(owner);
+  if (b != NULL && sub != NULL) {
+    if (!b->reader_running) {
+      linux_backend_poll_timeout(b, 0);
+    }
+    moonbit_bytes_t out = linux_state_bin(b);
+    subscriber_discard(b, sub);
+    return out;
+  }
+#else
+  (void)b;
+#endif
+  return moonbit_make_bytes_raw(0);
+}
+
+int32_t moon_gamepad_backend_gamepad_count(void *owner) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    return client_gamepad_count(c);
+  }
+#endif
+  if (b == NULL) {
+    return 0;
+  }
+#if defined(__linux__)
+  linux_reader_lock(b);
+  int32_t n = b->gamepad_count;
+  linux_reader_unlock(b);
+  return n;
+#else
+  return b->gamepad_count;
+#endif
+}
+
+int32_t moon_gamepad_backend_last_gamepad_hint(void *owner) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    return (int32_t)__atomic_load_n(&c->shm->device_hint, __ATOMIC_ACQUIRE);
+  }
+#endif
+  if (b == NULL) {
+    return 0;
+  }
+#if defined(__APPLE__)
+  return (int32_t)b->mac.devices_len;
+#elif defined(__linux__)
+  linux_reader_lock(b);
+  int32_t hint = (int32_t)b->next_id;
+  linux_reader_unlock(b);
+  return hint;
+#elif defined(_WIN32)
+  return 4;
+#else
+  return b->gamepad_count;
+#endif
+}
+
+#if defined(__APPLE__)
+static int mac_idx_by_id(moon_gamepad_backend_t *b, uint32_t id) {
+  if (b == NULL) {
+    return -1;
+  }
+  for (uint32_t i = 0; i < b->mac.devices_len; i++) {
+    if (b->mac.devices[i].id == id) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+#endif
+
+int32_t moon_gamepad_backend_is_connected(void *owner, int32_t id) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    moon_gamepad_shm_device_t d;
+    return client_device(c, id, &d);
+  }
+#endif
+  if (b == NULL || id < 0) {
+    return 0;
+  }
+#if defined(__APPLE__)
+  int idx = mac_idx_by_id(b, (uint32_t)id);
+  if (idx < 0) {
+    return 0;
+  }
+  return b->mac.devices[(uint32_t)idx].connected ? 1 : 0;
+#elif defined(__linux__)
+  linux_reader_lock(b);
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
+  linux_reader_unlock(b);
+  return (idx >= 0) ? 1 : 0;
+#elif defined(_WIN32)
+  if ((uint32_t)id >= 4) {
+    return 0;
+  }
+  return b->win_connected[(uint32_t)id] ? 1 : 0;
+#else
+  return 0;
+#endif
+}
+
+moonbit_string_t moon_gamepad_backend_name(void *owner, int32_t id) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    moon_gamepad_shm_device_t d;
+    return client_device(c, id, &d) ? moonbit_string_from_utf8_lossy(d.name) : moonbit_make_string_raw(0);
+  }
+#endif
+  if (b == NULL || id < 0) {
+    return moonbit_make_string_raw(0);
+  }
+#if defined(__APPLE__)
+  int idx = mac_idx_by_id(b, (uint32_t)id);
+  if (idx < 0) {
+    return moonbit_make_string_raw(0);
+  }
+  return moonbit_string_from_utf8_lossy(b->mac.devices[(uint32_t)idx].name);
+#elif defined(__linux__)
+  char buf[sizeof(b->names[0])];
+  linux_reader_lock(b);
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
+  if (idx >= 0) {
+    memcpy(buf, b->names[(uint32_t)idx], sizeof(buf));
+  }
+  linux_reader_unlock(b);
+  if (idx < 0) {
+    return moonbit_make_string_raw(0);
+  }
+  return moonbit_string_from_utf8_lossy(buf);
+#elif defined(_WIN32)
+  if ((uint32_t)id >= 4) {
+    return moonbit_make_string_raw(0);
+  }
+  return moonbit_string_from_utf8_lossy(b->win_names[(uint32_t)id]);
+#else
+  (void)b;
+  (void)id;
+  return moonbit_make_string_raw(0);
+#endif
+}
+
+moonbit_string_t moon_gamepad_backend_uuid_simple(void *owner, int32_t id) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    moon_gamepad_shm_device_t d;
+    return client_device(c, id, &d) ? moonbit_string_from_utf8_lossy(d.uuid) : moonbit_make_string_raw(0);
+  }
+#endif
+  if (b == NULL || id < 0) {
+    return moonbit_make_string_raw(0);
+  }
+#if defined(__APPLE__)
+  int idx = mac_idx_by_id(b, (uint32_t)id);
+  if (idx < 0) {
+    return moonbit_make_string_raw(0);
+  }
+  return moonbit_string_from_utf8_lossy(b->mac.devices[(uint32_t)idx].uuid);
+#elif defined(__linux__)
+  char buf[sizeof(b->uuids[0])];
+  linux_reader_lock(b);
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
+  if (idx >= 0) {
+    memcpy(buf, b->uuids[(uint32_t)idx], sizeof(buf));
+  }
+  linux_reader_unlock(b);
+  if (idx < 0) {
+    return moonbit_make_string_raw(0);
+  }
+  return moonbit_string_from_utf8_lossy(buf);
+#elif defined(_WIN32)
+  if ((uint32_t)id >= 4) {
+    return moonbit_make_string_raw(0);
+  }
+  return moonbit_string_from_utf8_lossy(b->win_uuids[(uint32_t)id]);
+#else
+  (void)b;
+  (void)id;
+  return moonbit_make_string_raw(0);
+#endif
+}
+
+int32_t moon_gamepad_backend_vendor_id(void *owner, int32_t id) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    moon_gamepad_shm_device_t d;
+    return client_device(c, id, &d) ? d.vendor : -1;
+  }
+#endif
+  if (b == NULL || id < 0) {
+    return -1;
+  }
+#if defined(__APPLE__)
+  int idx = mac_idx_by_id(b, (uint32_t)id);
+  if (idx < 0) {
+    return -1;
+  }
+  return b->mac.devices[(uint32_t)idx].vendor;
+#elif defined(__linux__)
+  linux_reader_lock(b);
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
+  int32_t v = idx < 0 ? -1 : b->vendors[(uint32_t)idx];
+  linux_reader_unlock(b);
+  return v;
+#else
+  (void)b;
+  (void)id;
+  return -1;
+#endif
+}
+
+int32_t moon_gamepad_backend_product_id(void *owner, int32_t id) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    moon_gamepad_shm_device_t d;
+    return client_device(c, id, &d) ? d.product : -1;
+  }
+#endif
+  if (b == NULL || id < 0) {
+    return -1;
+  }
+#if defined(__APPLE__)
+  int idx = mac_idx_by_id(b, (uint32_t)id);
+  if (idx < 0) {
+    return -1;
+  }
+  return b->mac.devices[(uint32_t)idx].product;
+#elif defined(__linux__)
+  linux_reader_lock(b);
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
+  int32_t v = idx < 0 ? -1 : b->products[(uint32_t)idx];
+  linux_reader_unlock(b);
+  return v;
+#else
+  (void)b;
+  (void)id;
+  return -1;
+#endif
+}
+
+int32_t moon_gamepad_backend_is_ff_supported(void *owner, int32_t id) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    moon_gamepad_shm_device_t d;
+    return client_device(c, id, &d) ? (int32_t)d.ff_supported : 0;
+  }
+#endif
+  if (b == NULL || id < 0) {
+    return 0;
+  }
+#if defined(__linux__)
+  linux_reader_lock(b);
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
+  int32_t v = idx < 0 ? 0 : (int32_t)b->ff_supported[(uint32_t)idx];
+  linux_reader_unlock(b);
+  return v;
+#elif defined(_WIN32)
+  if ((uint32_t)id >= 4) {
+    return 0;
+  }
+  return load_xinput_set_state(b) != NULL;
+#else
+  (void)b;
+  (void)id;
+  return 0;
+#endif
+}
+
+moonbit_bytes_t moon_gamepad_backend_power_info_bin(void *owner, int32_t id) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+  if (b == NULL || id < 0) {
+    return moonbit_make_bytes_raw(0);
+  }
+  int32_t tag = MOON_GAMEPAD_POWER_UNKNOWN;
+  int32_t value = 0;
+#if defined(_WIN32)
+  windows_power_info(b, (uint32_t)id, &tag, &value);
+#elif defined(__linux__)
+  char path[sizeof(b->paths[0])];
+  linux_reader_lock(b);
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
+  if (idx >= 0) {
+    memcpy(path, b->paths[(uint32_t)idx], sizeof(path));
+  }
+  linux_reader_unlock(b);
+  if (idx >= 0) {
+    linux_power_info_from_event_path(path, &tag, &value);
+  }
+#else
+  (void)b;
+  (void)id;
+#endif
+  moonbit_bytes_t out = moonbit_make_bytes_raw(8);
+  if (out == NULL) {
+    return moonbit_make_bytes_raw(0);
+  }
+  memcpy(out + 0, &tag, 4);
+  memcpy(out + 4, &value, 4);
+  return out;
+}
+
+moonbit_bytes_t moon_gamepad_backend_axes_bin(void *owner, int32_t id) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    moon_gamepad_shm_device_t d;
+    return client_device(c, id, &d) ? bytes_from_i32s(d.axes_codes, d.axes_len) : moonbit_make_bytes_raw(0);
+  }
+#endif
+  if (b == NULL || id < 0) {
+    return moonbit_make_bytes_raw(0);
+  }
+#if defined(__APPLE__)
+  int idx = mac_idx_by_id(b, (uint32_t)id);
+  if (idx < 0) {
+    return moonbit_make_bytes_raw(0);
+  }
+  mac_device_t *d = &b->mac.devices[(uint32_t)idx];
+  uint32_t len = d->axes.len;
+  if (len > (uint32_t)(INT32_MAX / 4)) {
+    return moonbit_make_bytes_raw(0);
+  }
+  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)len * 4);
+  if (out == NULL) {
+    return moonbit_make_bytes_raw(0);
+  }
+  for (uint32_t i = 0; i < len; i++) {
+    int32_t v = d->axes.codes[i];
+    memcpy(out + (int32_t)i * 4, &v, 4);
+  }
+  return out;
+#elif defined(__linux__)
+  int32_t codes[32];
+  uint8_t len = 0;
+  linux_reader_lock(b);
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
+  if (idx >= 0) {
+    len = b->axes_len[(uint32_t)idx];
+    memcpy(codes, b->axes_codes[(uint32_t)idx], (size_t)len * sizeof(int32_t));
+  }
+  linux_reader_unlock(b);
+  if (idx < 0) {
+    return moonbit_make_bytes_raw(0);
+  }
+  return bytes_from_i32s(codes, len);
+#elif defined(_WIN32)
+  if ((uint32_t)id >= 4 || !b->win_connected[(uint32_t)id]) {
+    return moonbit_make_bytes_raw(0);
+  }
+  uint8_t len = (uint8_t)(sizeof(WINDOWS_AXIS_CODES) / sizeof(WINDOWS_AXIS_CODES[0]));
+  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)len * 4);
+  if (out == NULL) {
+    return moonbit_make_bytes_raw(0);
+  }
+  for (uint8_t i = 0; i < len; i++) {
+    int32_t v = WINDOWS_AXIS_CODES[i];
+    memcpy(out + (int32_t)i * 4, &v, 4);
+  }
+  return out;
+#else
+  (void)b;
+  (void)id;
+  return moonbit_make_bytes_raw(0);
+#endif
+}
+
+moonbit_bytes_t moon_gamepad_backend_buttons_bin(void *owner, int32_t id) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    moon_gamepad_shm_device_t d;
+    return client_device(c, id, &d) ? bytes_from_i32s(d.buttons_codes, d.buttons_len) : moonbit_make_bytes_raw(0);
+  }
+#endif
+  if (b == NULL || id < 0) {
+    return moonbit_make_bytes_raw(0);
+  }
+#if defined(__APPLE__)
+  int idx = mac_idx_by_id(b, (uint32_t)id);
+  if (idx < 0) {
+    return moonbit_make_bytes_raw(0);
+  }
+  mac_device_t *d = &b->mac.devices[(uint32_t)idx];
+  uint32_t len = d->buttons.len;
+  if (len > (uint32_t)(INT32_MAX / 4)) {
+    return moonbit_make_bytes_raw(0);
+  }
+  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)len * 4);
+  if (out == NULL) {
+    return moonbit_make_bytes_raw(0);
+  }
+  for (uint32_t i = 0; i < len; i++) {
+    int32_t v = d->buttons.codes[i];
+    memcpy(out + (int32_t)i * 4, &v, 4);
+  }
+  return out;
+#elif defined(__linux__)
+  int32_t codes[64];
+  uint8_t len = 0;
+  linux_reader_lock(b);
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
+  if (idx >= 0) {
+    len = b->buttons_len[(uint32_t)idx];
+    memcpy(codes, b->buttons_codes[(uint32_t)idx], (size_t)len * sizeof(int32_t));
+  }
+  linux_reader_unlock(b);
+  if (idx < 0) {
+    return moonbit_make_bytes_raw(0);
+  }
+  return bytes_from_i32s(codes, len);
+#elif defined(_WIN32)
+  if ((uint32_t)id >= 4 || !b->win_connected[(uint32_t)id]) {
+    return moonbit_make_bytes_raw(0);
+  }
+  uint8_t len = (uint8_t)(sizeof(WINDOWS_BUTTON_CODES) / sizeof(WINDOWS_BUTTON_CODES[0]));
+  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)len * 4);
+  if (out == NULL) {
+    return moonbit_make_bytes_raw(0);
+  }
+  for (uint8_t i = 0; i < len; i++) {
+    int32_t v = WINDOWS_BUTTON_CODES[i];
+    memcpy(out + (int32_t)i * 4, &v, 4);
+  }
+  return out;
+#else
+  (void)b;
+  (void)id;
+  return moonbit_make_bytes_raw(0);
+#endif
+}
+
+moonbit_bytes_t moon_gamepad_backend_axis_info_bin(void *owner, int32_t id, int32_t code) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    moon_gamepad_shm_device_t d;
+    if (!client_device(c, id, &d)) {
+      return moonbit_make_bytes_raw(0);
+    }
+    int32_t info[4] = {0, 0, 0, -1};
+    for (uint8_t i = 0; i < d.axis_info_len; i++) {
+      if (d.axis_info_codes[i] == code) {
+        info[0] = 1;
+        info[1] = d.axis_info_min[i];
+        info[2] = d.axis_info_max[i];
+        info[3] = d.axis_info_deadzone[i];
+        break;
+      }
+    }
+    return bytes_from_i32s(info, 4);
+  }
+#endif
+  if (b == NULL || id < 0) {
+    return moonbit_make_bytes_raw(0);
+  }
+#if defined(__APPLE__)
+  int idx = mac_idx_by_id(b, (uint32_t)id);
+  if (idx < 0) {
+    return moonbit_make_bytes_raw(0);
+  }
+  mac_device_t *d = &b->mac.devices[(uint32_t)idx];
+  int32_t present = 0;
+  int32_t minv = 0;
+  int32_t maxv = 0;
+  int32_t deadzone = -1;
+  uint32_t len = d->axis_info.len;
+  for (uint32_t i = 0; i < len; i++) {
+    if (d->axis_info.codes[i] == code) {
+      present = 1;
+      minv = d->axis_info.minv[i];
+      maxv = d->axis_info.maxv[i];
+      break;
+    }
+  }
+  moonbit_bytes_t out = moonbit_make_bytes_raw(16);
+  if (out == NULL) {
+    return moonbit_make_bytes_raw(0);
+  }
+  memcpy(out + 0, &present, 4);
+  memcpy(out + 4, &minv, 4);
+  memcpy(out + 8, &maxv, 4);
+  memcpy(out + 12, &deadzone, 4);
+  return out;
+#elif defined(__linux__)
+  int32_t present = 0;
+  int32_t minv = 0;
+  int32_t maxv = 0;
+  int32_t deadzone = -1;
+  linux_reader_lock(b);
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
+  uint8_t len = idx < 0 ? 0 : b->axis_info_len[(uint32_t)idx];
+  for (uint8_t i = 0; i < len; i++) {
+    if (b->axis_info_codes[(uint32_t)idx][i] == code) {
+      present = 1;
+      minv = b->axis_info_min[(uint32_t)idx][i];
+      maxv = b->axis_info_max[(uint32_t)idx][i];
+      deadzone = b->axis_info_deadzone[(uint32_t)idx][i];
+      break;
+    }
+  }
+  linux_reader_unlock(b);
+  if (idx < 0) {
+    return moonbit_make_bytes_raw(0);
+  }
+  moonbit_bytes_t out = moonbit_make_bytes_raw(16);
+  if (out == NULL) {
+    return moonbit_make_bytes_raw(0);
+  }
+  memcpy(out + 0, &present, 4);
+  memcpy(out + 4, &minv, 4);
+  memcpy(out + 8, &maxv, 4);
+  memcpy(out + 12, &deadzone, 4);
+  return out;
+#elif defined(_WIN32)
+  if ((uint32_t)id >= 4 || !b->win_connected[(uint32_t)id]) {
+    return moonbit_make_bytes_raw(0);
+  }
+  int32_t present = 0;
+  int32_t minv = 0;
+  int32_t maxv = 0;
+  int32_t deadzone = -1;
+  size_t info_len = sizeof(WINDOWS_AXIS_INFO) / sizeof(WINDOWS_AXIS_INFO[0]);
+  for (size_t i = 0; i < info_len; i++) {
+    if (WINDOWS_AXIS_INFO[i].code == code) {
+      present = 1;
+      minv = WINDOWS_AXIS_INFO[i].minv;
+      maxv = WINDOWS_AXIS_INFO[i].maxv;
+      deadzone = WINDOWS_AXIS_INFO[i].deadzone;
+      break;
+    }
+  }
+  moonbit_bytes_t out = moonbit_make_bytes_raw(16);
+  if (out == NULL) {
+    return moonbit_make_bytes_raw(0);
+  }
+  memcpy(out + 0, &present, 4);
+  memcpy(out + 4, &minv, 4);
+  memcpy(out + 8, &maxv, 4);
+  memcpy(out + 12, &deadzone, 4);
+  return out;
+#else
+  (void)b;
+  (void)id;
+  (void)code;
+  return moonbit_make_bytes_raw(0);
+#endif
+}
+
+static uint16_t amp_to_u16(double x) {
+  if (x < 0.0) {
+    x = 0.0;
+  }
+  if (x > 1.0) {
+    x = 1.0;
+  }
+  double v = x * 65535.0;
+  if (v < 0.0) {
+    v = 0.0;
+  }
+  if (v > 65535.0) {
+    v = 65535.0;
+  }
+  return (uint16_t)(v + 0.5);
+}
+
+// Records this subscriber's request and returns the mix over all subscribers.
+static void backend_rumble_mix(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub, uint32_t id,
+                               uint16_t *strong, uint16_t *weak, int32_t *duration_ms) {
+  int64_t t = now_ms();
+  int64_t until = (*duration_ms > 0) ? t + (int64_t)*duration_ms : 0;
+  uint32_t slot = sub->rumble_len;
+  for (uint32_t i = 0; i < sub->rumble_len; i++) {
+    if (sub->rumble_ids[i] == id) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot == sub->rumble_len && slot < MOON_GAMEPAD_RUMBLE_SLOTS) {
+    sub->rumble_len++;
+  }
+  if (slot < MOON_GAMEPAD_RUMBLE_SLOTS) {
+    sub->rumble_ids[slot] = id;
+    sub->rumble_strong[slot] = *strong;
+    sub->rumble_weak[slot] = *weak;
+    sub->rumble_until_ms[slot] = until;
+  }
+  if (b->subs_len <= 1) {
+    return;
+  }
+  uint32_t sum_s = 0;
+  uint32_t sum_w = 0;
+  int64_t max_until = 0;
+  for (uint32_t k = 0; k < b->subs_len; k++) {
+    moon_gamepad_subscriber_t *o = b->subs[k];
+    for (uint32_t i = 0; i < o->rumble_len; i++) {
+      if (o->rumble_ids[i] != id || o->rumble_until_ms[i] <= t) {
+        continue;
+      }
+      sum_s += o->rumble_strong[i];
+      sum_w += o->rumble_weak[i];
+      if (o->rumble_until_ms[i] > max_until) {
+        max_until = o->rumble_until_ms[i];
+      }
+    }
+  }
+  *strong = (uint16_t)(sum_s > 0xFFFFu ? 0xFFFFu : sum_s);
+  *weak = (uint16_t)(sum_w > 0xFFFFu ? 0xFFFFu : sum_w);
+  *duration_ms = (max_until > t) ? (int32_t)(max_until - t) : 0;
+}
+
+// Mixes one request into `sub`'s share of device `id` and sends the sum.
+// On Linux the caller holds reader_mu.
+static int32_t backend_rumble_apply(moon_gamepad_backend_t *b, moon_gamepad_subscriber_t *sub, int32_t id,
+                                    uint16_t s, uint16_t w, int32_t duration_ms) {
+  if (id < 0) {
+    return 0;
+  }
+  backend_rumble_mix(b, sub, (uint32_t)id, &s, &w, &duration_ms);
+#if defined(__linux__)
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
+  return idx < 0 ? 0 : linux_ff_set_rumble_idx(b, (uint32_t)idx, s, w, duration_ms);
 #elif defined(_WIN32)
-  windows_backend_poll_timeout(b, timeout_ms);
+  if ((uint32_t)id >= 4) {
+    return 0;
+  }
+  return windows_rumble_set_idx(b, (uint32_t)id, s, w, duration_ms);
 #else
-  (void)b;
-  (void)timeout_ms;
+  return 0;
 #endif
 }
 
-int32_t moon_gamepad_backend_gamepad_count(void *owner) {
+static int32_t backend_set_rumble_u16(void *owner, int32_t id, uint16_t s, uint16_t w, int32_t duration_ms) {
   moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL) {
-    return 0;
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    return client_send_rumble(c, id, s, w, duration_ms);
   }
-  return b->gamepad_count;
-}
-
-int32_t moon_gamepad_backend_last_gamepad_hint(void *owner) {
-  moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL) {
+#endif
+  moon_gamepad_subscriber_t *sub = subscriber_of(owner);
+  if (b == NULL || sub == NULL || id < 0) {
     return 0;
   }
-#if defined(__APPLE__)
-  return (int32_t)b->mac.devices_len;
-#elif defined(__linux__)
-  return (int32_t)b->next_id;
-#elif defined(_WIN32)
-  return 4;
-#else
-  return b->gamepad_count;
+#if defined(__linux__)
+  linux_reader_lock(b);
 #endif
+  int32_t ok = backend_rumble_apply(b, sub, id, s, w, duration_ms);
+#if defined(__linux__)
+  linux_reader_unlock(b);
+#endif
+  return ok;
 }
 
-static int idx_by_id_u32(const uint32_t *ids, uint32_t len, uint32_t id) {
-  for (uint32_t i = 0; i < len; i++) {
-    if (ids[i] == id) {
-      return (int)i;
-    }
-  }
-  return -1;
+int32_t moon_gamepad_backend_set_rumble(void *owner, int32_t id, double strong, double weak, int32_t duration_ms) {
+  return backend_set_rumble_u16(owner, id, amp_to_u16(strong), amp_to_u16(weak), duration_ms);
 }
 
-#if defined(__APPLE__)
-static int mac_idx_by_id(moon_gamepad_backend_t *b, uint32_t id) {
-  if (b == NULL) {
-    return -1;
+static uint16_t rumble_u16_clamp(int32_t v) {
+  return (uint16_t)(v < 0 ? 0 : (v > 0xFFFF ? 0xFFFF : v));
+}
+
+// Applies `count` packed (id, strong, weak, duration_ms) records, with the
+// magnitudes already in 0..=0xFFFF, under one lock. A device listed twice
+// is mixed and sent once, with its last record. Returns one host-order i32
+// per record: 1 if the device accepted it, 0 otherwise.
+moonbit_bytes_t moon_gamepad_backend_set_rumble_batch(void *owner, int32_t *records, int32_t count) {
+  int32_t cap = records == NULL ? 0 : (int32_t)Moonbit_array_length(records) / 4;
+  if (count < 0) {
+    count = 0;
   }
-  for (uint32_t i = 0; i < b->mac.devices_len; i++) {
-    if (b->mac.devices[i].id == id) {
-      return (int)i;
+  if (count > cap) {
+    count = cap;
+  }
+  moonbit_bytes_t out = moonbit_make_bytes_raw(count * 4);
+  if (out == NULL) {
+    return moonbit_make_bytes_raw(0);
+  }
+  memset(out, 0, (size_t)count * 4);
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    for (int32_t i = 0; i < count; i++) {
+      const int32_t *r = records + i * 4;
+      int32_t ok = client_send_rumble(c, r[0], rumble_u16_clamp(r[1]), rumble_u16_clamp(r[2]), r[3]);
+      memcpy(out + i * 4, &ok, 4);
     }
+    return out;
   }
-  return -1;
-}
 #endif
-
-int32_t moon_gamepad_backend_is_connected(void *owner, int32_t id) {
-  moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL || id < 0) {
-    return 0;
+  moon_gamepad_subscriber_t *sub = subscriber_of(owner);
+  if (b == NULL || sub == NULL) {
+    return out;
   }
-#if defined(__APPLE__)
-  int idx = mac_idx_by_id(b, (uint32_t)id);
-  if (idx < 0) {
-    return 0;
+#if defined(__linux__)
+  linux_reader_lock(b);
+#endif
+  // Last record per device first, so earlier duplicates can copy its result.
+  for (int32_t i = count - 1; i >= 0; i--) {
+    const int32_t *r = records + i * 4;
+    int32_t later = -1;
+    for (int32_t j = i + 1; j < count && later < 0; j++) {
+      if (records[j * 4] == r[0]) {
+        later = j;
+      }
+    }
+    int32_t ok = 0;
+    if (later >= 0) {
+      memcpy(&ok, out + later * 4, 4);
+    } else {
+      ok = backend_rumble_apply(b, sub, r[0], rumble_u16_clamp(r[1]), rumble_u16_clamp(r[2]), r[3]);
+    }
+    memcpy(out + i * 4, &ok, 4);
   }
-  return b->mac.devices[(uint32_t)idx].connected ? 1 : 0;
-#elif defined(__linux__)
-  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
-  return (idx >= 0) ? 1 : 0;
-#elif defined(_WIN32)
-  if ((uint32_t)id >= 4) {
+#if defined(__linux__)
+  linux_reader_unlock(b);
+#endif
+  return out;
+}
+
+// Starts the FF scheduler thread at `hz` steps per second (capped at 1000),
+// or changes the rate of a running one. Returns the rate, 0 if unavailable.
+int32_t moon_gamepad_backend_ff_sched_start(void *owner, int32_t hz) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  if (b == NULL || client_of(owner) != NULL || hz <= 0) {
     return 0;
   }
-  return b->win_connected[(uint32_t)id] ? 1 : 0;
+  return linux_ff_sched_start(b, subscriber_of(owner), hz);
 #else
+  (void)b;
+  (void)hz;
   return 0;
 #endif
 }
 
-moonbit_string_t moon_gamepad_backend_name(void *owner, int32_t id) {
+// The rate the FF scheduler runs at for every user, 0 when it is stopped.
+int32_t moon_gamepad_backend_ff_sched_rate(void *owner) {
   moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL || id < 0) {
-    return moonbit_make_string_raw(0);
-  }
-#if defined(__APPLE__)
-  int idx = mac_idx_by_id(b, (uint32_t)id);
-  if (idx < 0) {
-    return moonbit_make_string_raw(0);
-  }
-  return moonbit_string_from_utf8_lossy(b->mac.devices[(uint32_t)idx].name);
-#elif defined(__linux__)
-  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
-  if (idx < 0) {
-    return moonbit_make_string_raw(0);
-  }
-  return moonbit_string_from_utf8_lossy(b->names[(uint32_t)idx]);
-#elif defined(_WIN32)
-  if ((uint32_t)id >= 4) {
-    return moonbit_make_string_raw(0);
+#if defined(__linux__)
+  if (b == NULL || client_of(owner) != NULL || !b->ff_sched_running) {
+    return 0;
   }
-  return moonbit_string_from_utf8_lossy(b->win_names[(uint32_t)id]);
+  return __atomic_load_n(&b->ff_sched_hz, __ATOMIC_ACQUIRE);
 #else
   (void)b;
-  (void)id;
-  return moonbit_make_string_raw(0);
+  return 0;
 #endif
 }
 
-moonbit_string_t moon_gamepad_backend_uuid_simple(void *owner, int32_t id) {
+// Withdraws the caller from the FF scheduler; the thread stops once no
+// subscriber uses it.
+void moon_gamepad_backend_ff_sched_stop(void *owner) {
   moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL || id < 0) {
-    return moonbit_make_string_raw(0);
-  }
-#if defined(__APPLE__)
-  int idx = mac_idx_by_id(b, (uint32_t)id);
-  if (idx < 0) {
-    return moonbit_make_string_raw(0);
-  }
-  return moonbit_string_from_utf8_lossy(b->mac.devices[(uint32_t)idx].uuid);
-#elif defined(__linux__)
-  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
-  if (idx < 0) {
-    return moonbit_make_string_raw(0);
-  }
-  return moonbit_string_from_utf8_lossy(b->uuids[(uint32_t)idx]);
-#elif defined(_WIN32)
-  if ((uint32_t)id >= 4) {
-    return moonbit_make_string_raw(0);
+#if defined(__linux__)
+  if (b != NULL && client_of(owner) == NULL) {
+    (void)linux_ff_sched_leave(b, subscriber_of(owner));
   }
-  return moonbit_string_from_utf8_lossy(b->win_uuids[(uint32_t)id]);
 #else
   (void)b;
-  (void)id;
-  return moonbit_make_string_raw(0);
 #endif
 }
 
-int32_t moon_gamepad_backend_vendor_id(void *owner, int32_t id) {
+// Replaces what the scheduler plays on device `id`; see linux_ff_sched_post.
+int32_t moon_gamepad_backend_ff_sched_post(void *owner, int32_t id, double *recs, int32_t count) {
   moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL || id < 0) {
-    return -1;
-  }
-#if defined(__APPLE__)
-  int idx = mac_idx_by_id(b, (uint32_t)id);
-  if (idx < 0) {
-    return -1;
-  }
-  return b->mac.devices[(uint32_t)idx].vendor;
-#elif defined(__linux__)
-  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
-  if (idx < 0) {
-    return -1;
+#if defined(__linux__)
+  if (b == NULL || !b->ff_sched_running || id < 0 || recs == NULL) {
+    return 0;
   }
-  return b->vendors[(uint32_t)idx];
+  int32_t cap = (int32_t)Moonbit_array_length(recs) / MOON_GAMEPAD_FF_SCHED_FIELDS;
+  return linux_ff_sched_post(b, subscriber_of(owner), (uint32_t)id, recs,
+                             count < 0 ? 0 : (count > cap ? cap : count));
 #else
   (void)b;
   (void)id;
-  return -1;
+  (void)recs;
+  (void)count;
+  return 0;
 #endif
 }
 
-int32_t moon_gamepad_backend_product_id(void *owner, int32_t id) {
+// Queues streamed rumble for device `id`; needs the scheduler thread.
+int32_t moon_gamepad_backend_ff_stream_push(void *owner, int32_t id, double *samples, int32_t count,
+                                            int32_t sample_rate) {
   moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL || id < 0) {
-    return -1;
-  }
-#if defined(__APPLE__)
-  int idx = mac_idx_by_id(b, (uint32_t)id);
-  if (idx < 0) {
-    return -1;
-  }
-  return b->mac.devices[(uint32_t)idx].product;
-#elif defined(__linux__)
-  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
-  if (idx < 0) {
-    return -1;
+#if defined(__linux__)
+  if (b == NULL || !b->ff_sched_running || id < 0 || samples == NULL || sample_rate <= 0) {
+    return 0;
   }
-  return b->products[(uint32_t)idx];
+  int32_t cap = (int32_t)Moonbit_array_length(samples);
+  return linux_ff_stream_push(b, subscriber_of(owner), (uint32_t)id, samples,
+                              count < 0 ? 0 : (count > cap ? cap : count), sample_rate);
 #else
   (void)b;
   (void)id;
-  return -1;
+  (void)samples;
+  (void)count;
+  (void)sample_rate;
+  return 0;
 #endif
 }
 
-int32_t moon_gamepad_backend_is_ff_supported(void *owner, int32_t id) {
+// Ends the caller's stream on device `id`; see linux_ff_stream_end.
+int32_t moon_gamepad_backend_ff_stream_end(void *owner, int32_t id) {
   moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL || id < 0) {
-    return 0;
-  }
 #if defined(__linux__)
-  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
-  if (idx < 0) {
-    return 0;
-  }
-  return (int32_t)b->ff_supported[(uint32_t)idx];
-#elif defined(_WIN32)
-  if ((uint32_t)id >= 4) {
+  if (b == NULL || client_of(owner) != NULL || !b->ff_sched_running || id < 0) {
     return 0;
   }
-  return load_xinput_set_state(b) != NULL;
+  return linux_ff_stream_end(b, subscriber_of(owner), (uint32_t)id);
 #else
   (void)b;
   (void)id;
@@ -3352,306 +8358,345 @@ int32_t moon_gamepad_backend_is_ff_supported(void *owner, int32_t id) {
 #endif
 }
 
-moonbit_bytes_t moon_gamepad_backend_power_info_bin(void *owner, int32_t id) {
+// The caller's queued, underruns, dropped and played samples on device `id`
+// as i32, empty without a stream.
+moonbit_bytes_t moon_gamepad_backend_ff_stream_stats_bin(void *owner, int32_t id) {
   moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL || id < 0) {
-    return moonbit_make_bytes_raw(0);
-  }
-  int32_t tag = MOON_GAMEPAD_POWER_UNKNOWN;
-  int32_t value = 0;
-#if defined(_WIN32)
-  windows_power_info(b, (uint32_t)id, &tag, &value);
-#elif defined(__linux__)
-  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
-  if (idx >= 0) {
-    linux_power_info_from_event_path(b->paths[(uint32_t)idx], &tag, &value);
+#if defined(__linux__)
+  if (b != NULL && b->ff_sched_running && id >= 0) {
+    int32_t v[4];
+    int found = 0;
+    pthread_mutex_lock(&b->ff_sched_mu);
+    linux_ff_stream_t *st = linux_ff_stream_find(b, subscriber_of(owner), (uint32_t)id, 0);
+    if (st != NULL) {
+      v[0] = (int32_t)st->len;
+      v[1] = (int32_t)st->underruns;
+      v[2] = (int32_t)st->dropped;
+      v[3] = (int32_t)st->played;
+      found = 1;
+    }
+    pthread_mutex_unlock(&b->ff_sched_mu);
+    if (found) {
+      moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)sizeof(v));
+      if (out == NULL) {
+        return moonbit_make_bytes_raw(0);
+      }
+      memcpy(out, v, sizeof(v));
+      return out;
+    }
   }
 #else
   (void)b;
   (void)id;
 #endif
-  moonbit_bytes_t out = moonbit_make_bytes_raw(8);
-  if (out == NULL) {
-    return moonbit_make_bytes_raw(0);
-  }
-  memcpy(out + 0, &tag, 4);
-  memcpy(out + 4, &value, 4);
-  return out;
+  return moonbit_make_bytes_raw(0);
 }
 
-moonbit_bytes_t moon_gamepad_backend_axes_bin(void *owner, int32_t id) {
+// Hands one base effect to the driver, keyed by `token`. Returns 0 when the
+// device (or a broker client) cannot play it; the caller then mixes it in
+// software.
+int32_t moon_gamepad_backend_ff_offload(void *owner, int32_t id, int32_t token, int32_t strong,
+                                        int32_t magnitude, int32_t length_ms, int32_t delay_ms,
+                                        int32_t count, int32_t attack_ms, int32_t attack_level,
+                                        int32_t fade_ms, int32_t fade_level) {
   moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL || id < 0) {
-    return moonbit_make_bytes_raw(0);
-  }
-#if defined(__APPLE__)
-  int idx = mac_idx_by_id(b, (uint32_t)id);
-  if (idx < 0) {
-    return moonbit_make_bytes_raw(0);
-  }
-  mac_device_t *d = &b->mac.devices[(uint32_t)idx];
-  uint32_t len = d->axes.len;
-  if (len > (uint32_t)(INT32_MAX / 4)) {
-    return moonbit_make_bytes_raw(0);
-  }
-  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)len * 4);
-  if (out == NULL) {
-    return moonbit_make_bytes_raw(0);
-  }
-  for (uint32_t i = 0; i < len; i++) {
-    int32_t v = d->axes.codes[i];
-    memcpy(out + (int32_t)i * 4, &v, 4);
-  }
-  return out;
-#elif defined(__linux__)
-  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
-  if (idx < 0) {
-    return moonbit_make_bytes_raw(0);
-  }
-  uint8_t len = b->axes_len[(uint32_t)idx];
-  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)len * 4);
-  if (out == NULL) {
-    return moonbit_make_bytes_raw(0);
-  }
-  for (uint8_t i = 0; i < len; i++) {
-    int32_t v = b->axes_codes[(uint32_t)idx][i];
-    memcpy(out + (int32_t)i * 4, &v, 4);
-  }
-  return out;
-#elif defined(_WIN32)
-  if ((uint32_t)id >= 4 || !b->win_connected[(uint32_t)id]) {
-    return moonbit_make_bytes_raw(0);
-  }
-  uint8_t len = (uint8_t)(sizeof(WINDOWS_AXIS_CODES) / sizeof(WINDOWS_AXIS_CODES[0]));
-  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)len * 4);
-  if (out == NULL) {
-    return moonbit_make_bytes_raw(0);
-  }
-  for (uint8_t i = 0; i < len; i++) {
-    int32_t v = WINDOWS_AXIS_CODES[i];
-    memcpy(out + (int32_t)i * 4, &v, 4);
+#if defined(__linux__)
+  if (b == NULL || client_of(owner) != NULL || id < 0) {
+    return 0;
   }
-  return out;
+  linux_ff_offload_req_t req;
+  req.strong = strong;
+  req.magnitude = (uint16_t)magnitude;
+  req.length_ms = length_ms;
+  req.delay_ms = delay_ms;
+  req.count = count;
+  req.attack_ms = attack_ms;
+  req.attack_level = (uint16_t)attack_level;
+  req.fade_ms = fade_ms;
+  req.fade_level = (uint16_t)fade_level;
+  linux_reader_lock(b);
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
+  int32_t ok = idx < 0 ? 0 : linux_ff_offload_play(b, (uint32_t)idx, subscriber_of(owner), token, &req);
+  linux_reader_unlock(b);
+  return ok;
 #else
   (void)b;
   (void)id;
-  return moonbit_make_bytes_raw(0);
+  (void)token;
+  (void)strong;
+  (void)magnitude;
+  (void)length_ms;
+  (void)delay_ms;
+  (void)count;
+  (void)attack_ms;
+  (void)attack_level;
+  (void)fade_ms;
+  (void)fade_level;
+  return 0;
 #endif
 }
 
-moonbit_bytes_t moon_gamepad_backend_buttons_bin(void *owner, int32_t id) {
+void moon_gamepad_backend_ff_offload_stop(void *owner, int32_t id, int32_t token) {
   moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL || id < 0) {
-    return moonbit_make_bytes_raw(0);
-  }
-#if defined(__APPLE__)
-  int idx = mac_idx_by_id(b, (uint32_t)id);
-  if (idx < 0) {
-    return moonbit_make_bytes_raw(0);
-  }
-  mac_device_t *d = &b->mac.devices[(uint32_t)idx];
-  uint32_t len = d->buttons.len;
-  if (len > (uint32_t)(INT32_MAX / 4)) {
-    return moonbit_make_bytes_raw(0);
-  }
-  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)len * 4);
-  if (out == NULL) {
-    return moonbit_make_bytes_raw(0);
-  }
-  for (uint32_t i = 0; i < len; i++) {
-    int32_t v = d->buttons.codes[i];
-    memcpy(out + (int32_t)i * 4, &v, 4);
+#if defined(__linux__)
+  if (b == NULL || client_of(owner) != NULL || id < 0) {
+    return;
   }
-  return out;
-#elif defined(__linux__)
+  linux_reader_lock(b);
   int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
-  if (idx < 0) {
-    return moonbit_make_bytes_raw(0);
-  }
-  uint8_t len = b->buttons_len[(uint32_t)idx];
-  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)len * 4);
-  if (out == NULL) {
-    return moonbit_make_bytes_raw(0);
-  }
-  for (uint8_t i = 0; i < len; i++) {
-    int32_t v = b->buttons_codes[(uint32_t)idx][i];
-    memcpy(out + (int32_t)i * 4, &v, 4);
+  if (idx >= 0) {
+    linux_ff_offload_stop(b, (uint32_t)idx, subscriber_of(owner), token);
   }
-  return out;
-#elif defined(_WIN32)
-  if ((uint32_t)id >= 4 || !b->win_connected[(uint32_t)id]) {
-    return moonbit_make_bytes_raw(0);
+  linux_reader_unlock(b);
+#else
+  (void)b;
+  (void)id;
+  (void)token;
+#endif
+}
+
+// Frees the slot the caller's `token` holds on every device, for effects
+// that will not be played again.
+void moon_gamepad_backend_ff_offload_drop(void *owner, int32_t token) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  if (b == NULL || client_of(owner) != NULL) {
+    return;
   }
-  uint8_t len = (uint8_t)(sizeof(WINDOWS_BUTTON_CODES) / sizeof(WINDOWS_BUTTON_CODES[0]));
-  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)len * 4);
-  if (out == NULL) {
-    return moonbit_make_bytes_raw(0);
+  linux_reader_lock(b);
+  for (uint32_t idx = 0; idx < b->fds_len; idx++) {
+    int k = linux_ff_offload_find(b, idx, subscriber_of(owner), token);
+    if (k >= 0) {
+      linux_ff_offload_erase(b, idx, k);
+    }
   }
-  for (uint8_t i = 0; i < len; i++) {
-    int32_t v = WINDOWS_BUTTON_CODES[i];
-    memcpy(out + (int32_t)i * 4, &v, 4);
+  linux_reader_unlock(b);
+#else
+  (void)b;
+  (void)token;
+#endif
+}
+
+int32_t moon_gamepad_backend_set_ff_gain(void *owner, int32_t id, double gain) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+#if defined(__linux__)
+  if (b == NULL || client_of(owner) != NULL || id < 0) {
+    return 0;
   }
-  return out;
+  linux_reader_lock(b);
+  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
+  int32_t ok = idx < 0 ? 0 : linux_ff_set_gain_idx(b, (uint32_t)idx, amp_to_u16(gain));
+  linux_reader_unlock(b);
+  return ok;
 #else
   (void)b;
   (void)id;
-  return moonbit_make_bytes_raw(0);
+  (void)gain;
+  return 0;
 #endif
 }
 
-moonbit_bytes_t moon_gamepad_backend_axis_info_bin(void *owner, int32_t id, int32_t code) {
+// Returns Bytes. Empty bytes => None.
+moonbit_bytes_t moon_gamepad_backend_next_event_bin(void *owner) {
   moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL || id < 0) {
-    return moonbit_make_bytes_raw(0);
-  }
-#if defined(__APPLE__)
-  int idx = mac_idx_by_id(b, (uint32_t)id);
-  if (idx < 0) {
-    return moonbit_make_bytes_raw(0);
-  }
-  mac_device_t *d = &b->mac.devices[(uint32_t)idx];
-  int32_t present = 0;
-  int32_t minv = 0;
-  int32_t maxv = 0;
-  int32_t deadzone = -1;
-  uint32_t len = d->axis_info.len;
-  for (uint32_t i = 0; i < len; i++) {
-    if (d->axis_info.codes[i] == code) {
-      present = 1;
-      minv = d->axis_info.minv[i];
-      maxv = d->axis_info.maxv[i];
-      break;
+#if defined(__linux__)
+  moon_gamepad_client_t *c = client_of(owner);
+  if (c != NULL) {
+    moon_gamepad_event_t ev;
+    if (!client_pop(c, &ev)) {
+      return moonbit_make_bytes_raw(0);
     }
+    moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)sizeof(ev));
+    if (out == NULL) {
+      return moonbit_make_bytes_raw(0);
+    }
+    memcpy(out, &ev, sizeof(ev));
+    return out;
   }
-  moonbit_bytes_t out = moonbit_make_bytes_raw(16);
-  if (out == NULL) {
+#endif
+  if (b == NULL) {
     return moonbit_make_bytes_raw(0);
   }
-  memcpy(out + 0, &present, 4);
-  memcpy(out + 4, &minv, 4);
-  memcpy(out + 8, &maxv, 4);
-  memcpy(out + 12, &deadzone, 4);
-  return out;
-#elif defined(__linux__)
-  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
-  if (idx < 0) {
+  moon_gamepad_subscriber_t *sub = subscriber_of(owner);
+  moon_gamepad_event_t ev;
+  if (sub == NULL || !subscriber_pop(b, sub, &ev)) {
     return moonbit_make_bytes_raw(0);
   }
-  int32_t present = 0;
-  int32_t minv = 0;
-  int32_t maxv = 0;
-  int32_t deadzone = -1;
-  uint8_t len = b->axis_info_len[(uint32_t)idx];
-  for (uint8_t i = 0; i < len; i++) {
-    if (b->axis_info_codes[(uint32_t)idx][i] == code) {
-      present = 1;
-      minv = b->axis_info_min[(uint32_t)idx][i];
-      maxv = b->axis_info_max[(uint32_t)idx][i];
-      deadzone = b->axis_info_deadzone[(uint32_t)idx][i];
-      break;
-    }
-  }
-  moonbit_bytes_t out = moonbit_make_bytes_raw(16);
+  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)sizeof(ev));
   if (out == NULL) {
     return moonbit_make_bytes_raw(0);
   }
-  memcpy(out + 0, &present, 4);
-  memcpy(out + 4, &minv, 4);
-  memcpy(out + 8, &maxv, 4);
-  memcpy(out + 12, &deadzone, 4);
+  memcpy(out, &ev, sizeof(ev));
   return out;
-#elif defined(_WIN32)
-  if ((uint32_t)id >= 4 || !b->win_connected[(uint32_t)id]) {
+}
+
+// Like next_event_bin, but only returns events for `id`. Empty bytes => None.
+moonbit_bytes_t moon_gamepad_backend_next_event_for_bin(void *owner, int32_t id) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+  moon_gamepad_subscriber_t *sub = subscriber_of(owner);
+  moon_gamepad_event_t ev;
+#if defined(__linux__)
+  if (client_of(owner) != NULL) {
+    // The shared-memory ring is a single stream; clients drain it in order.
     return moonbit_make_bytes_raw(0);
   }
-  int32_t present = 0;
-  int32_t minv = 0;
-  int32_t maxv = 0;
-  int32_t deadzone = -1;
-  size_t info_len = sizeof(WINDOWS_AXIS_INFO) / sizeof(WINDOWS_AXIS_INFO[0]);
-  for (size_t i = 0; i < info_len; i++) {
-    if (WINDOWS_AXIS_INFO[i].code == code) {
-      present = 1;
-      minv = WINDOWS_AXIS_INFO[i].minv;
-      maxv = WINDOWS_AXIS_INFO[i].maxv;
-      deadzone = WINDOWS_AXIS_INFO[i].deadzone;
-      break;
-    }
+#endif
+  if (b == NULL || sub == NULL || id < 0 || !subscriber_pop_for(b, sub, (uint32_t)id, &ev)) {
+    return moonbit_make_bytes_raw(0);
   }
-  moonbit_bytes_t out = moonbit_make_bytes_raw(16);
+  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)sizeof(ev));
   if (out == NULL) {
     return moonbit_make_bytes_raw(0);
   }
-  memcpy(out + 0, &present, 4);
-  memcpy(out + 4, &minv, 4);
-  memcpy(out + 8, &maxv, 4);
-  memcpy(out + 12, &deadzone, 4);
+  memcpy(out, &ev, sizeof(ev));
   return out;
-#else
-  (void)b;
-  (void)id;
-  (void)code;
-  return moonbit_make_bytes_raw(0);
-#endif
 }
 
-static uint16_t amp_to_u16(double x) {
-  if (x < 0.0) {
-    x = 0.0;
+void moon_gamepad_backend_set_per_device_queues(void *owner, int32_t enabled) {
+  moon_gamepad_backend_t *b = backend_of(owner);
+  moon_gamepad_subscriber_t *sub = subscriber_of(owner);
+  if (b == NULL || sub == NULL) {
+    return;
   }
-  if (x > 1.0) {
-    x = 1.0;
+  int held = backend_subs_lock(b);
+  sub->per_device = enabled != 0;
+  backend_subs_unlock(b, held);
+}
+
+// -----------------------------------------------------------------------------
+// Broker extern API
+// -----------------------------------------------------------------------------
+
+typedef struct moon_gamepad_broker_owner_payload_t {
+#if defined(__linux__)
+  moon_gamepad_broker_t *br;
+#else
+  void *br;
+#endif
+} moon_gamepad_broker_owner_payload_t;
+
+static void broker_finalize(void *self) {
+  moon_gamepad_broker_owner_payload_t *p = (moon_gamepad_broker_owner_payload_t *)self;
+  if (p == NULL) {
+    return;
   }
-  double v = x * 65535.0;
-  if (v < 0.0) {
-    v = 0.0;
+#if defined(__linux__)
+  broker_free(p->br);
+#endif
+  p->br = NULL;
+}
+
+void *moon_gamepad_broker_new(moonbit_string_t name, int32_t open_devices) {
+  moon_gamepad_broker_owner_payload_t *p = (moon_gamepad_broker_owner_payload_t *)moonbit_make_external_object(
+      broker_finalize, (uint32_t)sizeof(*p));
+  if (p == NULL) {
+    return NULL;
   }
-  if (v > 65535.0) {
-    v = 65535.0;
+  p->br = NULL;
+#if defined(__linux__)
+  char *n = moonbit_string_to_ascii_cstr(name);
+  if (n != NULL) {
+    p->br = broker_open(n, open_devices);
+    free(n);
   }
-  return (uint16_t)(v + 0.5);
+#else
+  (void)name;
+  (void)open_devices;
+#endif
+  return p;
 }
 
-int32_t moon_gamepad_backend_set_rumble(void *owner, int32_t id, double strong, double weak, int32_t duration_ms) {
-  moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL || id < 0) {
+int32_t moon_gamepad_broker_is_open(void *owner) {
+  moon_gamepad_broker_owner_payload_t *p = (moon_gamepad_broker_owner_payload_t *)owner;
+  return (p != NULL && p->br != NULL) ? 1 : 0;
+}
+
+int32_t moon_gamepad_broker_pump(void *owner, int32_t timeout_ms) {
+  moon_gamepad_broker_owner_payload_t *p = (moon_gamepad_broker_owner_payload_t *)owner;
+  if (p == NULL || p->br == NULL) {
     return 0;
   }
-  uint16_t s = amp_to_u16(strong);
-  uint16_t w = amp_to_u16(weak);
 #if defined(__linux__)
-  int idx = idx_by_id_u32(b->fd_ids, b->fds_len, (uint32_t)id);
-  if (idx < 0) {
+  return broker_pump(p->br, timeout_ms);
+#else
+  (void)timeout_ms;
+  return 0;
+#endif
+}
+
+int32_t moon_gamepad_broker_add_synthetic(void *owner, moonbit_string_t name, int32_t ff_supported) {
+  moon_gamepad_broker_owner_payload_t *p = (moon_gamepad_broker_owner_payload_t *)owner;
+  if (p == NULL || p->br == NULL) {
+    return -1;
+  }
+#if defined(__linux__)
+  char *n = moonbit_string_to_ascii_cstr(name);
+  if (n == NULL) {
+    return -1;
+  }
+  int32_t id = broker_add_synthetic(p->br, n, ff_supported);
+  free(n);
+  return id;
+#else
+  (void)name;
+  (void)ff_supported;
+  return -1;
+#endif
+}
+
+int32_t moon_gamepad_broker_synthetic_event(void *owner, int32_t id, int32_t tag, int32_t code, double value) {
+  moon_gamepad_broker_owner_payload_t *p = (moon_gamepad_broker_owner_payload_t *)owner;
+  if (p == NULL || p->br == NULL || id < 0 || tag < 0 || tag > MOON_GAMEPAD_EV_BUTTON_CHANGED) {
     return 0;
   }
-  return linux_ff_set_rumble_idx(b, (uint32_t)idx, s, w, duration_ms);
-#elif defined(_WIN32)
-  if ((uint32_t)id >= 4) {
+#if defined(__linux__)
+  if ((uint32_t)id >= p->br->map_len || p->br->map_src[id] != 1) {
     return 0;
   }
-  return windows_rumble_set_idx(b, (uint32_t)id, s, w, duration_ms);
+  moon_gamepad_event_t ev = {(uint32_t)tag, (uint32_t)id, (uint32_t)code, 0, value, now_ms()};
+  return broker_emit(p->br, (uint32_t)id, ev);
 #else
-  (void)s;
-  (void)w;
-  (void)duration_ms;
+  (void)code;
+  (void)value;
   return 0;
 #endif
 }
 
-// Returns Bytes. Empty bytes => None.
-moonbit_bytes_t moon_gamepad_backend_next_event_bin(void *owner) {
-  moon_gamepad_backend_t *b = backend_of(owner);
-  if (b == NULL) {
+// Returns Bytes: i32 strong, i32 weak (last rumble applied for the broker id).
+moonbit_bytes_t moon_gamepad_broker_rumble_bin(void *owner, int32_t id) {
+  moon_gamepad_broker_owner_payload_t *p = (moon_gamepad_broker_owner_payload_t *)owner;
+  if (p == NULL || p->br == NULL || id < 0) {
     return moonbit_make_bytes_raw(0);
   }
-  moon_gamepad_event_t ev;
-  if (!queue_pop(&b->q, &ev)) {
+#if defined(__linux__)
+  if ((uint32_t)id >= p->br->map_len) {
     return moonbit_make_bytes_raw(0);
   }
-  moonbit_bytes_t out = moonbit_make_bytes_raw((int32_t)sizeof(ev));
-  if (out == NULL) {
-    return moonbit_make_bytes_raw(0);
+  int32_t v[2] = {p->br->shm->devices[id].rumble_strong, p->br->shm->devices[id].rumble_weak};
+  return bytes_from_i32s(v, 2);
+#else
+  return moonbit_make_bytes_raw(0);
+#endif
+}
+
+void *moon_gamepad_backend_attach_broker(moonbit_string_t name) {
+  moon_gamepad_backend_owner_payload_t *p = backend_owner_alloc(0);
+  if (p == NULL) {
+    return NULL;
   }
-  memcpy(out, &ev, sizeof(ev));
-  return out;
+#if defined(__linux__)
+  char *n = moonbit_string_to_ascii_cstr(name);
+  if (n != NULL) {
+    p->client = client_attach(n);
+    free(n);
+  }
+#else
+  (void)name;
+#endif
+  return p;
+}
+
+int32_t moon_gamepad_backend_is_broker_client(void *owner) {
+  moon_gamepad_backend_owner_payload_t *p = (moon_gamepad_backend_owner_payload_t *)owner;
+  return (p != NULL && p->client != NULL) ? 1 : 0;
 }